@@ -1,13 +1,6 @@
 #include "autotests.h"
 
-struct API : testing::Test {
-	AMFFactoryHelper helper;
-	AMFContextPtr context1;
-	AMFComputeFactoryPtr oclComputeFactory;
-	AMFFactory* factory;
-	int deviceCount;
-	chrono::time_point<chrono::system_clock> startTime;
-
+struct API : OpenCLFixture {
 	static void SetUpTestCase() {
 		initiateTestSuiteLog("API");
 	}
@@ -15,30 +8,10 @@ struct API : testing::Test {
 	static void TearDownTestCase() {
 		terminateTestSuiteLog();
 	}
-
-	API() {
-		helper.Init();
-		factory = helper.GetFactory();
-		factory->CreateContext(&context1);
-		context1->SetProperty(AMF_CONTEXT_DEVICE_TYPE, AMF_CONTEXT_DEVICE_TYPE_GPU);
-		context1->GetOpenCLComputeFactory(&oclComputeFactory);
-		context1->InitOpenCL();
-		deviceCount = oclComputeFactory->GetDeviceCount();
-		g_AMFFactory.Init();
-		startTime = initiateTestLog();
-	}
-
-	~API() {
-		context1.Release();
-		oclComputeFactory.Release();
-		g_AMFFactory.Terminate();
-		helper.Terminate();
-		terminateTestLog(startTime);
-	}
 };
 
 TEST_F(API, kernel2_compute_complex_copenCl) {
-	g_AMFFactory.GetFactory()->SetCacheFolder(L"./cache");
+	amfRuntime->GetFactory()->SetCacheFolder(L"./cache");
 
 	AMFPrograms* pPrograms;
 	factory->GetPrograms(&pPrograms);
@@ -59,7 +32,7 @@ TEST_F(API, kernel2_compute_complex_copenCl) {
 		"}                     \n";
 	pPrograms->RegisterKernelSource(&kernel, L"kernelIDName", "multiplication", strlen(kernel_src), (amf_uint8*)kernel_src, NULL);
 
-	for (int i = 0; i < deviceCount; ++i)
+	for (int i = 0; i < oclComputeFactory->GetDeviceCount(); ++i)
 	{
 		AMF_RESULT res;
 		AMFComputeDevicePtr pComputeDevice;
@@ -87,10 +60,11 @@ TEST_F(API, kernel2_compute_complex_copenCl) {
 		float* inputData = static_cast<float*>(input->GetNative());
 		float* inputData2 = static_cast<float*>(input2->GetNative());
 		float* expectedData = new float[1024];
+		TestDataGenerator generator;
+		generator.FillUniform(inputData, 1024, 0.0f, 655.0f);
+		generator.FillUniform(inputData2, 1024, 0.0f, 655.0f);
 		for (int k = 0; k < 1024; k++)
 		{
-			inputData[k] = rand() / 50.00;
-			inputData2[k] = rand() / 50.00;
 			expectedData[k] = inputData[k] * inputData2[k];
 		}
 
@@ -122,7 +96,7 @@ TEST_F(API, kernel2_compute_complex_copenCl) {
 }
 
 TEST_F(API, DISABLED_kernel_compute_complex) {
-	g_AMFFactory.GetFactory()->SetCacheFolder(L"./cache");
+	amfRuntime->GetFactory()->SetCacheFolder(L"./cache");
 
 	amf::AMFPrograms* pPrograms;
 	factory->GetPrograms(&pPrograms);
@@ -137,7 +111,7 @@ TEST_F(API, DISABLED_kernel_compute_complex) {
 		"}                     \n";
 	pPrograms->RegisterKernelSource(&kernel, L"kernelIDName", "square2", strlen(kernel_src), (amf_uint8*)kernel_src, NULL);
 
-	for (int i = 0; i < deviceCount; ++i)
+	for (int i = 0; i < oclComputeFactory->GetDeviceCount(); ++i)
 	{
 		AMF_RESULT res;
 		amf::AMFComputeDevicePtr pComputeDevice;
@@ -163,9 +137,10 @@ TEST_F(API, DISABLED_kernel_compute_complex) {
 
 		float* inputData = static_cast<float*>(input->GetNative());
 		float* expectedData = new float[1024];
+		TestDataGenerator generator;
+		generator.FillUniform(inputData, 1024, 0.0f, 655.0f);
 		for (int k = 0; k < 1024; k++)
 		{
-			inputData[k] = rand() / 50.00;
 			expectedData[k] = inputData[k] * inputData[k];
 		}
 
@@ -199,7 +174,7 @@ TEST_F(API, DISABLED_kernel_compute_complex) {
 }
 
 TEST_F(API, DISABLED_dimensions_2_kernel) {
-	g_AMFFactory.GetFactory()->SetCacheFolder(L"./cache");
+	amfRuntime->GetFactory()->SetCacheFolder(L"./cache");
 
 	amf::AMFPrograms* pPrograms;
 	factory->GetPrograms(&pPrograms);
@@ -214,7 +189,7 @@ TEST_F(API, DISABLED_dimensions_2_kernel) {
 		"}                     \n";
 	pPrograms->RegisterKernelSource(&kernel, L"kernelIDName", "square2", strlen(kernel_src), (amf_uint8*)kernel_src, NULL);
 
-	for (int i = 0; i < deviceCount; ++i)
+	for (int i = 0; i < oclComputeFactory->GetDeviceCount(); ++i)
 	{
 		AMF_RESULT res;
 		amf::AMFComputeDevicePtr pComputeDevice;
@@ -240,9 +215,10 @@ TEST_F(API, DISABLED_dimensions_2_kernel) {
 
 		float* inputData = static_cast<float*>(input->GetNative());
 		float* expectedData = new float[1024];
+		TestDataGenerator generator;
+		generator.FillUniform(inputData, 1024, 0.0f, 655.0f);
 		for (int k = 0; k < 1024; k++)
 		{
-			inputData[k] = rand() / 50.00;
 			expectedData[k] = inputData[k] * inputData[k];
 		}
 
@@ -0,0 +1,173 @@
+#include "async.h"
+
+struct Async : OpenCLFixture {
+	static void SetUpTestCase() {
+		initiateTestSuiteLog("Async");
+	}
+
+	static void TearDownTestCase() {
+		terminateTestSuiteLog();
+	}
+};
+
+// Every task gets its own data, so a task handed back another task's buffer fails the comparison
+static AsyncTask bufferRoundTrip(AsyncExecutor& executor, AMFCompute* compute, AMFBuffer* buffer, size_t count, int task) {
+	vector<float> source(count);
+	vector<float> dest(count);
+	TestDataGenerator generator(testDataSeed() + task);
+	generator.FillUniform(source.data(), count, 0.0f, 655.0f);
+	co_await executor.CopyBufferFromHost(compute, source.data(), count * sizeof(float), buffer, 0);
+	co_await executor.CopyBufferToHost(compute, buffer, 0, count * sizeof(float), dest.data());
+	EXPECT_EQ(source, dest);
+}
+
+TEST_F(Async, copyBuffer_roundTrips) {
+	const int tasks = 32;
+	const size_t count = 64 * 1024;
+	vector<AMFBufferPtr> buffers(tasks);
+	AsyncExecutor executor;
+	for (int t = 0; t < tasks; t++) {
+		context1->AllocBuffer(AMF_MEMORY_OPENCL, count * sizeof(float), &buffers[t]);
+		executor.Spawn(bufferRoundTrip(executor, compute.Get(), buffers[t], count, t));
+	}
+	executor.Run();
+	logTestMetric("Max operations in flight", (double)executor.MaxInFlight(), "");
+}
+
+static AsyncTask planeRoundTrip(AsyncExecutor& executor, AMFCompute* compute, AMFPlane* plane, amf_uint8 fill) {
+	const amf_size width = plane->GetWidth();
+	const amf_size height = plane->GetHeight();
+	const amf_size pitch = width * plane->GetPixelSizeInBytes();
+	amf_size origin[3] = { 0, 0, 0 };
+	amf_size region[3] = { width, height, 1 };
+	vector<amf_uint8> source(pitch * height, fill);
+	vector<amf_uint8> dest(pitch * height, 0);
+	co_await executor.CopyPlaneFromHost(compute, source.data(), origin, region, pitch, plane);
+	co_await executor.CopyPlaneToHost(compute, plane, origin, region, dest.data(), pitch);
+	EXPECT_EQ(source, dest);
+}
+
+TEST_F(Async, copyPlaneFromHost_roundTrips) {
+	const int tasks = 16;
+	vector<AMFSurfacePtr> surfaces(tasks);
+	AsyncExecutor executor;
+	for (int t = 0; t < tasks; t++) {
+		context1->AllocSurface(AMF_MEMORY_OPENCL, AMF_SURFACE_RGBA, 256, 256, &surfaces[t]);
+		executor.Spawn(planeRoundTrip(executor, compute.Get(), surfaces[t]->GetPlane(AMF_PLANE_PACKED), (amf_uint8)(t + 1)));
+	}
+	executor.Run();
+}
+
+static AsyncTask multiply(AsyncExecutor& executor, AMFContext* context, AMFCompute* compute, AMFComputeKernel* kernel, int count,
+	int task) {
+	AMFBufferPtr input;
+	AMFBufferPtr input2;
+	AMFBufferPtr output;
+	context->AllocBuffer(AMF_MEMORY_HOST, count * sizeof(float), &input);
+	context->AllocBuffer(AMF_MEMORY_HOST, count * sizeof(float), &input2);
+	context->AllocBuffer(AMF_MEMORY_OPENCL, count * sizeof(float), &output);
+	float* inputData = static_cast<float*>(input->GetNative());
+	float* inputData2 = static_cast<float*>(input2->GetNative());
+	TestDataGenerator generator(testDataSeed() + task);
+	generator.FillUniform(inputData, count, 0.0f, 655.0f);
+	generator.FillUniform(inputData2, count, 0.0f, 655.0f);
+	vector<float> expectedData(count);
+	for (int k = 0; k < count; k++)
+	{
+		expectedData[k] = inputData[k] * inputData2[k];
+	}
+	input->Convert(AMF_MEMORY_OPENCL);
+	input2->Convert(AMF_MEMORY_OPENCL);
+
+	// Nothing suspends between setting the arguments and the enqueue, so coroutines can share the kernel.
+	// Each task multiplies different inputs, so arguments left over from another task fail the check.
+	kernel->SetArgBuffer(0, output, AMF_ARGUMENT_ACCESS_WRITE);
+	kernel->SetArgBuffer(1, input, AMF_ARGUMENT_ACCESS_READ);
+	kernel->SetArgBuffer(2, input2, AMF_ARGUMENT_ACCESS_READ);
+	kernel->SetArgInt32(3, count);
+	amf_size sizeLocal[3] = { 0, 0, 0 };
+	amf_size sizeGlobal[3] = { (amf_size)count, 0, 0 };
+	amf_size offset[3] = { 0, 0, 0 };
+	kernel->GetCompileWorkgroupSize(sizeLocal);
+	co_await executor.Enqueue(compute, kernel, 1, offset, sizeGlobal, sizeLocal);
+
+	vector<float> outputData(count);
+	co_await executor.CopyBufferToHost(compute, output, 0, count * sizeof(float), outputData.data());
+	for (int k = 0; k < count; k++)
+	{
+		EXPECT_LE(abs(expectedData[k] - outputData[k]), 0.01);
+	}
+}
+
+TEST_F(Async, kernel_completion) {
+	AMFPrograms* pPrograms;
+	factory->GetPrograms(&pPrograms);
+	AMF_KERNEL_ID kernel = 0;
+	const char* kernel_src = "\n" \
+		"__kernel void multiplication(__global float* output, __global float* input, __global float* input2, \n" \
+		" const unsigned int count) {            \n" \
+		" int i = get_global_id(0);              \n" \
+		" if(i < count) \n" \
+		" output[i] = input[i] * input2[i]; \n" \
+		"}                     \n";
+	pPrograms->RegisterKernelSource(&kernel, L"kernelIDName", "multiplication", strlen(kernel_src), (amf_uint8*)kernel_src, NULL);
+	AMFComputeKernelPtr pKernel;
+	ASSERT_EQ(compute->GetKernel(kernel, &pKernel), AMF_OK);
+
+	AMFContextPtr context;
+	factory->CreateContext(&context);
+	context->InitOpenCL(compute->GetNativeCommandQueue());
+
+	const int tasks = 8;
+	AsyncExecutor executor;
+	for (int t = 0; t < tasks; t++) {
+		executor.Spawn(multiply(executor, context, compute.Get(), pKernel, 1024, t));
+	}
+	executor.Run();
+}
+
+static AsyncTask downloadLoop(AsyncExecutor& executor, AMFCompute* compute, AMFBuffer* buffer, size_t size,
+	int iterations, LatencyHistogram& latencies) {
+	vector<char> dest(size);
+	for (int i = 0; i < iterations; i++) {
+		auto start = chrono::steady_clock::now();
+		co_await executor.CopyBufferToHost(compute, buffer, 0, size, dest.data());
+		latencies.Record(chrono::steady_clock::now() - start);
+	}
+}
+
+TEST_F(Async, copyBufferToHost_queueDepthSaturation) {
+	const size_t size = 1024 * 1024;
+	const int totalCopies = 512;
+	const int maxDepth = 64;
+	vector<AMFBufferPtr> buffers(maxDepth);
+	for (int t = 0; t < maxDepth; t++) {
+		context1->AllocBuffer(AMF_MEMORY_OPENCL, size, &buffers[t]);
+	}
+
+	double bestThroughput = 0;
+	vector<pair<int, double>> throughputs;
+	for (int depth = 1; depth <= maxDepth; depth *= 2) {
+		LatencyHistogram latencies;
+		AsyncExecutor executor;
+		auto runStart = chrono::steady_clock::now();
+		for (int t = 0; t < depth; t++) {
+			executor.Spawn(downloadLoop(executor, compute.Get(), buffers[t], size, totalCopies / depth, latencies));
+		}
+		executor.Run();
+		chrono::duration<double> runTime = chrono::steady_clock::now() - runStart;
+		double throughput = totalCopies * (size / 1048576.0) / runTime.count();
+		throughputs.push_back(make_pair(depth, throughput));
+		bestThroughput = throughput > bestThroughput ? throughput : bestThroughput;
+		logTestMetric("Download throughput at depth " + to_string(depth), throughput, "MB/s");
+		logLatencyHistogram("Download latency at depth " + to_string(depth), latencies);
+	}
+
+	// The first depth within 5% of the best throughput is where the device saturates
+	for (auto& measured : throughputs) {
+		if (measured.second >= bestThroughput * 0.95) {
+			logTestMetric("Saturation queue depth", measured.first, "");
+			break;
+		}
+	}
+}
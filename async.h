@@ -0,0 +1,174 @@
+#pragma once
+#ifndef H_UTILITY_ASYNC
+#define H_UTILITY_ASYNC
+#include "autotests.h"
+#include <coroutine>
+#include <deque>
+#include <exception>
+
+// Coroutine support for driving many non-blocking AMFCompute operations from one thread.
+// Requires C++20, so only the tests that use it include this header.
+
+class AsyncExecutor;
+
+// Coroutine type for asynchronous tests. The body starts when the task is spawned on an executor.
+// Use EXPECT_* inside: ASSERT_* returns from the function, which coroutines cannot do.
+struct AsyncTask {
+	struct promise_type {
+		exception_ptr exception;
+
+		AsyncTask get_return_object() {
+			return AsyncTask(coroutine_handle<promise_type>::from_promise(*this));
+		}
+
+		suspend_always initial_suspend() noexcept {
+			return {};
+		}
+
+		suspend_always final_suspend() noexcept {
+			return {};
+		}
+
+		void return_void() {}
+
+		void unhandled_exception() {
+			exception = current_exception();
+		}
+	};
+
+	coroutine_handle<promise_type> handle;
+
+	explicit AsyncTask(coroutine_handle<promise_type> handle) : handle(handle) {}
+
+	AsyncTask(AsyncTask&& other) noexcept : handle(other.handle) {
+		other.handle = nullptr;
+	}
+
+	AsyncTask(const AsyncTask&) = delete;
+
+	~AsyncTask() {
+		if (handle) {
+			handle.destroy();
+		}
+	}
+};
+
+// Resumes coroutines once the sync point put after their operation reports completion.
+// Every awaited operation is submitted non-blocking, so the queue depth is the number of
+// coroutines currently waiting.
+class AsyncExecutor {
+public:
+	struct SyncPointAwaiter {
+		AsyncExecutor& executor;
+		AMFComputeSyncPointPtr syncPoint;
+
+		bool await_ready() {
+			return !syncPoint;
+		}
+
+		void await_suspend(coroutine_handle<> waiting) {
+			executor.pending.push_back(make_pair(syncPoint, waiting));
+			if (executor.pending.size() > executor.maxInFlight) {
+				executor.maxInFlight = executor.pending.size();
+			}
+		}
+
+		void await_resume() {}
+	};
+
+	~AsyncExecutor() {
+		for (auto& task : tasks) {
+			task.destroy();
+		}
+	}
+
+	void Spawn(AsyncTask task) {
+		tasks.push_back(task.handle);
+		ready.push_back(task.handle);
+		task.handle = nullptr;
+	}
+
+	// Runs until every spawned coroutine has finished, rethrowing the first exception one of them raised
+	void Run() {
+		while (!ready.empty() || !pending.empty()) {
+			while (!ready.empty()) {
+				coroutine_handle<> next = ready.front();
+				ready.pop_front();
+				next.resume();
+			}
+			bool progressed = false;
+			for (auto it = pending.begin(); it != pending.end();) {
+				if (it->first->IsCompleted()) {
+					ready.push_back(it->second);
+					it = pending.erase(it);
+					progressed = true;
+				}
+				else {
+					++it;
+				}
+			}
+			if (!progressed && ready.empty()) {
+				this_thread::yield();
+			}
+		}
+		exception_ptr exception;
+		for (auto& task : tasks) {
+			if (!exception) {
+				exception = task.promise().exception;
+			}
+			task.destroy();
+		}
+		tasks.clear();
+		if (exception) {
+			rethrow_exception(exception);
+		}
+	}
+
+	size_t MaxInFlight() const {
+		return maxInFlight;
+	}
+
+	// Completes when everything queued on compute so far has finished
+	SyncPointAwaiter Completion(AMFCompute* compute) {
+		AMFComputeSyncPointPtr syncPoint;
+		compute->PutSyncPoint(&syncPoint);
+		compute->FlushQueue();
+		return SyncPointAwaiter{ *this, syncPoint };
+	}
+
+	SyncPointAwaiter CopyBufferToHost(AMFCompute* compute, AMFBuffer* source, amf_size offset, amf_size size, void* dest) {
+		compute->CopyBufferToHost(source, offset, size, dest, false);
+		return Completion(compute);
+	}
+
+	SyncPointAwaiter CopyBufferFromHost(AMFCompute* compute, const void* source, amf_size size, AMFBuffer* dest, amf_size offset) {
+		compute->CopyBufferFromHost(source, size, dest, offset, false);
+		return Completion(compute);
+	}
+
+	SyncPointAwaiter CopyPlaneFromHost(AMFCompute* compute, void* source, const amf_size origin[3], const amf_size region[3],
+		amf_size hostPitch, AMFPlane* dest) {
+		compute->CopyPlaneFromHost(source, origin, region, hostPitch, dest, false);
+		return Completion(compute);
+	}
+
+	SyncPointAwaiter CopyPlaneToHost(AMFCompute* compute, AMFPlane* source, const amf_size origin[3], const amf_size region[3],
+		void* dest, amf_size hostPitch) {
+		compute->CopyPlaneToHost(source, origin, region, dest, hostPitch, false);
+		return Completion(compute);
+	}
+
+	SyncPointAwaiter Enqueue(AMFCompute* compute, AMFComputeKernel* kernel, amf_size dimension, amf_size* offset,
+		amf_size* globalSize, amf_size* localSize) {
+		kernel->Enqueue(dimension, offset, globalSize, localSize);
+		return Completion(compute);
+	}
+
+private:
+	deque<coroutine_handle<AsyncTask::promise_type>> tasks;
+	deque<coroutine_handle<>> ready;
+	deque<pair<AMFComputeSyncPointPtr, coroutine_handle<>>> pending;
+	size_t maxInFlight = 0;
+};
+
+#endif
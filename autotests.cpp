@@ -1,48 +1,973 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <tlhelp32.h>
+#endif
 #include "autotests.h"
 #ifndef UTILITY_AUTOTESTS
 #define UTILITY_AUTOTESTS
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#endif
+#if defined(_M_X64) || defined(__x86_64__)
+#define AUTOTESTS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
 
 struct TestsInformation {
 	uint32_t tests_ran = 0;
 };
 
 uint32_t AllocationMetrics::CurrentUsage() {
-	return totalAllocated - totalFreed;
+	return totalAllocated.load(memory_order_relaxed) - totalFreed.load(memory_order_relaxed);
 };
 
 uint32_t AllocationMetrics::CurrentPointers() {
-	return totalPointersMade - totalPointersDestroyed;
+	return totalPointersMade.load(memory_order_relaxed) - totalPointersDestroyed.load(memory_order_relaxed);
 };
 
 TestsInformation testsInfo;
 AllocationMetrics memoryUsage;
 ofstream logFile;
+vector<pair<string, chrono::duration<double>>> subsystemInits;
 
+#ifdef _MSC_VER
 int allocationHook(int allocType, void* userData, std::size_t size, int blockType, long requestNumber,
 	const unsigned char* filename, int lineNumber) {
 	if (allocType == _HOOK_ALLOC) {
-		memoryUsage.totalAllocated += size;
-		memoryUsage.totalPointersMade++;
+		memoryUsage.totalAllocated.fetch_add((uint32_t)size, memory_order_relaxed);
+		memoryUsage.totalPointersMade.fetch_add(1, memory_order_relaxed);
 	}
 	else if (allocType == _HOOK_FREE){
-		memoryUsage.totalFreed += size;
-		memoryUsage.totalPointersMade--;
+		memoryUsage.totalFreed.fetch_add((uint32_t)size, memory_order_relaxed);
+		memoryUsage.totalPointersMade.fetch_sub(1, memory_order_relaxed);
 	}
 	return 0;
 }
+#endif
 
+// Every block carries its size in front of it, so unsized deletes are accounted for as well
 void* operator new(size_t size) {
-	memoryUsage.totalAllocated += size;
-	memoryUsage.totalPointersMade++;
+	memoryUsage.totalAllocated.fetch_add((uint32_t)size, memory_order_relaxed);
+	memoryUsage.totalPointersMade.fetch_add(1, memory_order_relaxed);
 
-	return malloc(size);
+	size_t* block = (size_t*)malloc(size + sizeof(max_align_t));
+	if (!block) {
+		throw bad_alloc();
+	}
+	*block = size;
+	return (char*)block + sizeof(max_align_t);
 }
 
-void operator delete(void* memory, size_t size) {
-	memoryUsage.totalFreed += size;
-	memoryUsage.totalPointersDestroyed++;
+void operator delete(void* memory) noexcept {
+	if (!memory) {
+		return;
+	}
+	size_t* block = (size_t*)((char*)memory - sizeof(max_align_t));
+	memoryUsage.totalFreed.fetch_add((uint32_t)*block, memory_order_relaxed);
+	memoryUsage.totalPointersDestroyed.fetch_add(1, memory_order_relaxed);
 
-	free(memory);
+	free(block);
+}
+
+void operator delete(void* memory, size_t size) noexcept {
+	operator delete(memory);
+}
+
+const char* perfCounterNames[PERF_COUNTER_COUNT] = {
+	"Cycles",
+	"Instructions",
+	"Cache misses",
+	"Branch misses",
+	"Context switches",
+	"Page faults"
+};
+
+#ifdef __linux__
+struct PerfEventState {
+	bool opened = false;
+	int leader = -1;
+	int fds[PERF_COUNTER_COUNT] = { -1, -1, -1, -1, -1, -1 };
+	uint64_t startValues[PERF_COUNTER_COUNT] = {};
+	uint64_t startEnabled[PERF_COUNTER_COUNT] = {};
+	uint64_t startRunning[PERF_COUNTER_COUNT] = {};
+
+	// Group members are closed before the leader
+	~PerfEventState() {
+		for (int i = PERF_COUNTER_COUNT - 1; i >= 0; i--) {
+			if (fds[i] != -1) {
+				close(fds[i]);
+			}
+		}
+	}
+};
+
+PerfEventState perfState;
+
+static int openPerfEvent(uint32_t type, uint64_t config, int groupFd) {
+	perf_event_attr attr = {};
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = groupFd == -1;
+	// Inherited so that threads spawned by the AMF runtime are counted as well
+	attr.inherit = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	int fd = syscall(__NR_perf_event_open, &attr, 0, -1, groupFd, 0);
+	if (fd == -1) {
+		// perf_event_paranoid > 1 forbids kernel-side counting for unprivileged users
+		attr.exclude_kernel = 1;
+		fd = syscall(__NR_perf_event_open, &attr, 0, -1, groupFd, 0);
+	}
+	return fd;
+}
+
+static void openPerfCounters() {
+	perfState.opened = true;
+	if (!getenv("AMF_AUTOTESTS_PERF_COUNTERS")) {
+		return;
+	}
+	const uint32_t types[PERF_COUNTER_COUNT] = {
+		PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+		PERF_TYPE_HARDWARE, PERF_TYPE_SOFTWARE, PERF_TYPE_SOFTWARE
+	};
+	const uint64_t configs[PERF_COUNTER_COUNT] = {
+		PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES,
+		PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_SW_CONTEXT_SWITCHES, PERF_COUNT_SW_PAGE_FAULTS
+	};
+	// The first counter that opens leads the group, so all of them are scheduled together
+	for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+		perfState.fds[i] = openPerfEvent(types[i], configs[i], perfState.leader);
+		if (perfState.leader == -1) {
+			perfState.leader = perfState.fds[i];
+		}
+	}
+	if (perfState.leader != -1) {
+		ioctl(perfState.leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	}
+}
+
+static bool readPerfEvent(int fd, uint64_t& value, uint64_t& enabled, uint64_t& running) {
+	uint64_t data[3];
+	if (fd == -1 || read(fd, data, sizeof(data)) != sizeof(data)) {
+		return false;
+	}
+	value = data[0];
+	enabled = data[1];
+	running = data[2];
+	return true;
+}
+#endif
+
+void startPerfCounters() {
+#ifdef __linux__
+	if (!perfState.opened) {
+		openPerfCounters();
+	}
+	for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+		readPerfEvent(perfState.fds[i], perfState.startValues[i], perfState.startEnabled[i], perfState.startRunning[i]);
+	}
+#endif
+}
+
+PerfCounters stopPerfCounters() {
+	PerfCounters counters;
+#ifdef __linux__
+	for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+		uint64_t value, enabled, running;
+		if (!readPerfEvent(perfState.fds[i], value, enabled, running)) {
+			continue;
+		}
+		uint64_t delta = value - perfState.startValues[i];
+		uint64_t enabledDelta = enabled - perfState.startEnabled[i];
+		uint64_t runningDelta = running - perfState.startRunning[i];
+		// Scale up when the PMU was multiplexed between groups during the window
+		if (runningDelta && runningDelta < enabledDelta) {
+			delta = (uint64_t)((double)delta * enabledDelta / runningDelta);
+		}
+		counters.values[i] = delta;
+		counters.available[i] = runningDelta > 0 || enabledDelta == 0;
+	}
+#endif
+	return counters;
+}
+
+void recordSubsystemInit(const string& name, chrono::duration<double> cost) {
+	subsystemInits.push_back(make_pair(name, cost));
+}
+
+chrono::duration<double> subsystemInitTotal() {
+	chrono::duration<double> total = chrono::duration<double>::zero();
+	for (auto& init : subsystemInits) {
+		total += init.second;
+	}
+	return total;
+}
+
+uint64_t testDataSeed() {
+	static uint64_t seed = 0;
+	static bool seeded = false;
+	if (!seeded) {
+		const char* env = getenv("AMF_AUTOTESTS_SEED");
+		seed = env ? strtoull(env, NULL, 0) : (uint64_t)chrono::system_clock::now().time_since_epoch().count();
+		seeded = true;
+	}
+	return seed;
+}
+
+static inline uint64_t mixCounter(uint64_t key, uint64_t counter) {
+	uint64_t z = key + (counter + 1) * 0x9E3779B97F4A7C15ull;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+// Per-fill parameters. The element hash only needs 32-bit multiplies, so that the SIMD kernels
+// can compute eight elements at once; the upper counter bits are folded into the first key.
+struct FillParams {
+	uint32_t key0;
+	uint32_t key1;
+	float offset;
+	float scale;
+};
+
+static const uint32_t hashGolden = 0x9E3779B9u;
+static const uint32_t hashMix1 = 0x85EBCA6Bu;
+static const uint32_t hashMix2 = 0xC2B2AE35u;
+static const uint32_t hashHigh = 0x7FEB352Du;
+static const uint32_t normalKey = 0x68E31DA4u;
+static const float unitScale = 1.0f / 16777216.0f;
+static const float twoPi = 6.28318530718f;
+
+static const float edgeCaseValues[16] = {
+	0.0f, -0.0f, 1.0f, -1.0f,
+	numeric_limits<float>::denorm_min(), -numeric_limits<float>::denorm_min(),
+	FLT_MIN / 2, -FLT_MIN / 2, FLT_MIN, -FLT_MIN, FLT_EPSILON, FLT_MAX, -FLT_MAX,
+	numeric_limits<float>::infinity(), -numeric_limits<float>::infinity(),
+	numeric_limits<float>::quiet_NaN()
+};
+
+static inline uint32_t hashCounter(uint32_t key0, uint32_t key1, uint64_t counter) {
+	uint32_t z = (uint32_t)counter * hashGolden + key0 + (uint32_t)(counter >> 32) * hashHigh;
+	z = (z ^ (z >> 16)) * hashMix1;
+	z = ((z ^ (z >> 13)) ^ key1) * hashMix2;
+	return z ^ (z >> 16);
+}
+
+static inline float unitFloat(uint32_t bits) {
+	return (float)(bits >> 8) * unitScale;
+}
+
+// Natural logarithm of a positive normal float (Cephes logf polynomial)
+static inline float logPositive(float value) {
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	int exponent = (int)(bits >> 23) - 127;
+	bits = (bits & 0x7FFFFF) | 0x3F800000;
+	float mantissa;
+	memcpy(&mantissa, &bits, sizeof(mantissa));
+	if (mantissa > 1.41421356f) {
+		mantissa = mantissa * 0.5f;
+		exponent++;
+	}
+	float e = (float)exponent;
+	float x = mantissa - 1.0f;
+	float z = x * x;
+	float y = 7.0376836292E-2f;
+	y = y * x - 1.1514610310E-1f;
+	y = y * x + 1.1676998740E-1f;
+	y = y * x - 1.2420140846E-1f;
+	y = y * x + 1.4249322787E-1f;
+	y = y * x - 1.6668057665E-1f;
+	y = y * x + 2.0000714765E-1f;
+	y = y * x - 2.4999993993E-1f;
+	y = y * x + 3.3333331174E-1f;
+	y = y * x * z;
+	y = y + e * -2.12194440E-4f;
+	y = y + z * -0.5f;
+	x = x + y;
+	return x + e * 0.693359375f;
+}
+
+// cos(2 pi u) for u in [0, 1), as sin(x) with x = 2 pi (|u - 0.5| - 0.25) in [-pi/2, pi/2]
+static inline float cosTwoPi(float u) {
+	float x = twoPi * (fabs(u - 0.5f) - 0.25f);
+	float x2 = x * x;
+	float y = -2.5052108E-8f;
+	y = y * x2 + 2.7557319E-6f;
+	y = y * x2 - 1.9841270E-4f;
+	y = y * x2 + 8.3333333E-3f;
+	y = y * x2 - 1.6666667E-1f;
+	y = y * x2 + 1.0f;
+	return y * x;
+}
+
+static void uniformScalar(const FillParams& params, float* data, size_t begin, size_t end) {
+	for (size_t k = begin; k < end; k++) {
+		data[k] = params.offset + unitFloat(hashCounter(params.key0, params.key1, k)) * params.scale;
+	}
+}
+
+static void normalScalar(const FillParams& params, float* data, size_t begin, size_t end) {
+	for (size_t k = begin; k < end; k++) {
+		// Box-Muller over two hashes per element; 1 - u keeps the logarithm finite
+		float u1 = 1.0f - unitFloat(hashCounter(params.key0, params.key1, k));
+		float u2 = unitFloat(hashCounter(params.key0, params.key1 ^ normalKey, k));
+		data[k] = params.offset + params.scale * sqrt(-2.0f * logPositive(u1)) * cosTwoPi(u2);
+	}
+}
+
+static void edgeCasesScalar(const FillParams& params, float* data, size_t begin, size_t end) {
+	for (size_t k = begin; k < end; k++) {
+		uint32_t bits = hashCounter(params.key0, params.key1, k);
+		// One element in four is special, the rest are ordinary values in [-1, 1)
+		data[k] = (bits & 3) == 0 ? edgeCaseValues[(bits >> 2) & 15] : unitFloat(bits) * 2.0f - 1.0f;
+	}
+}
+
+#ifdef AUTOTESTS_X86
+#ifdef __GNUC__
+#define AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define AVX2_TARGET
+#endif
+
+static bool cpuHasAvx2() {
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	// AVX needs both CPU support and the OS saving the YMM registers
+	if (!(info[2] & (1 << 27)) || !(info[2] & (1 << 28)) || (_xgetbv(0) & 6) != 6) {
+		return false;
+	}
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+// Hashes of the eight counters starting at base, which never crosses a 2^32 boundary
+AVX2_TARGET static inline __m256i hash8(const FillParams& params, uint32_t key1, uint64_t base) {
+	__m256i counter = _mm256_add_epi32(_mm256_set1_epi32((int)(uint32_t)base), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+	__m256i key0 = _mm256_set1_epi32((int)(params.key0 + (uint32_t)(base >> 32) * hashHigh));
+	__m256i z = _mm256_add_epi32(_mm256_mullo_epi32(counter, _mm256_set1_epi32((int)hashGolden)), key0);
+	z = _mm256_mullo_epi32(_mm256_xor_si256(z, _mm256_srli_epi32(z, 16)), _mm256_set1_epi32((int)hashMix1));
+	z = _mm256_xor_si256(_mm256_xor_si256(z, _mm256_srli_epi32(z, 13)), _mm256_set1_epi32((int)key1));
+	z = _mm256_mullo_epi32(z, _mm256_set1_epi32((int)hashMix2));
+	return _mm256_xor_si256(z, _mm256_srli_epi32(z, 16));
+}
+
+AVX2_TARGET static inline __m256 unitFloat8(__m256i bits) {
+	return _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(bits, 8)), _mm256_set1_ps(unitScale));
+}
+
+AVX2_TARGET static inline __m256 polynomial8(__m256 y, __m256 x, float coefficient) {
+	return _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(coefficient));
+}
+
+// Same operations, in the same order, as logPositive; no FMA so the results match bit for bit
+AVX2_TARGET static inline __m256 logPositive8(__m256 value) {
+	__m256i bits = _mm256_castps_si256(value);
+	__m256i exponent = _mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127));
+	__m256 mantissa = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x7FFFFF)), _mm256_set1_epi32(0x3F800000)));
+	__m256 large = _mm256_cmp_ps(mantissa, _mm256_set1_ps(1.41421356f), _CMP_GT_OQ);
+	mantissa = _mm256_blendv_ps(mantissa, _mm256_mul_ps(mantissa, _mm256_set1_ps(0.5f)), large);
+	exponent = _mm256_sub_epi32(exponent, _mm256_castps_si256(large));
+	__m256 e = _mm256_cvtepi32_ps(exponent);
+	__m256 x = _mm256_sub_ps(mantissa, _mm256_set1_ps(1.0f));
+	__m256 z = _mm256_mul_ps(x, x);
+	__m256 y = _mm256_set1_ps(7.0376836292E-2f);
+	y = polynomial8(y, x, -1.1514610310E-1f);
+	y = polynomial8(y, x, 1.1676998740E-1f);
+	y = polynomial8(y, x, -1.2420140846E-1f);
+	y = polynomial8(y, x, 1.4249322787E-1f);
+	y = polynomial8(y, x, -1.6668057665E-1f);
+	y = polynomial8(y, x, 2.0000714765E-1f);
+	y = polynomial8(y, x, -2.4999993993E-1f);
+	y = polynomial8(y, x, 3.3333331174E-1f);
+	y = _mm256_mul_ps(_mm256_mul_ps(y, x), z);
+	y = _mm256_add_ps(y, _mm256_mul_ps(e, _mm256_set1_ps(-2.12194440E-4f)));
+	y = _mm256_add_ps(y, _mm256_mul_ps(z, _mm256_set1_ps(-0.5f)));
+	x = _mm256_add_ps(x, y);
+	return _mm256_add_ps(x, _mm256_mul_ps(e, _mm256_set1_ps(0.693359375f)));
+}
+
+AVX2_TARGET static inline __m256 cosTwoPi8(__m256 u) {
+	__m256 centered = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), _mm256_sub_ps(u, _mm256_set1_ps(0.5f)));
+	__m256 x = _mm256_mul_ps(_mm256_set1_ps(twoPi), _mm256_sub_ps(centered, _mm256_set1_ps(0.25f)));
+	__m256 x2 = _mm256_mul_ps(x, x);
+	__m256 y = _mm256_set1_ps(-2.5052108E-8f);
+	y = polynomial8(y, x2, 2.7557319E-6f);
+	y = polynomial8(y, x2, -1.9841270E-4f);
+	y = polynomial8(y, x2, 8.3333333E-3f);
+	y = polynomial8(y, x2, -1.6666667E-1f);
+	y = polynomial8(y, x2, 1.0f);
+	return _mm256_mul_ps(y, x);
+}
+
+AVX2_TARGET static inline __m256 uniform8(const FillParams& params, uint64_t base) {
+	__m256 unit = unitFloat8(hash8(params, params.key1, base));
+	return _mm256_add_ps(_mm256_set1_ps(params.offset), _mm256_mul_ps(unit, _mm256_set1_ps(params.scale)));
+}
+
+AVX2_TARGET static inline __m256 normal8(const FillParams& params, uint64_t base) {
+	__m256 u1 = _mm256_sub_ps(_mm256_set1_ps(1.0f), unitFloat8(hash8(params, params.key1, base)));
+	__m256 u2 = unitFloat8(hash8(params, params.key1 ^ normalKey, base));
+	__m256 radius = _mm256_sqrt_ps(_mm256_mul_ps(_mm256_set1_ps(-2.0f), logPositive8(u1)));
+	__m256 value = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(params.scale), radius), cosTwoPi8(u2));
+	return _mm256_add_ps(_mm256_set1_ps(params.offset), value);
+}
+
+AVX2_TARGET static inline __m256 edgeCases8(const FillParams& params, uint64_t base) {
+	__m256i bits = hash8(params, params.key1, base);
+	__m256 ordinary = _mm256_sub_ps(_mm256_mul_ps(unitFloat8(bits), _mm256_set1_ps(2.0f)), _mm256_set1_ps(1.0f));
+	__m256i index = _mm256_and_si256(_mm256_srli_epi32(bits, 2), _mm256_set1_epi32(15));
+	__m256 special = _mm256_i32gather_ps(edgeCaseValues, index, 4);
+	__m256i isSpecial = _mm256_cmpeq_epi32(_mm256_and_si256(bits, _mm256_set1_epi32(3)), _mm256_setzero_si256());
+	return _mm256_blendv_ps(ordinary, special, _mm256_castsi256_ps(isSpecial));
+}
+
+// Ranges start at a multiple of 8; the last partial block goes through a temporary so every
+// element is computed by the same kernel regardless of where the range ends
+#define AVX2_FILL_RANGE(name, kernel) \
+AVX2_TARGET static void name(const FillParams& params, float* data, size_t begin, size_t end) { \
+	size_t k = begin; \
+	for (; k + 8 <= end; k += 8) { \
+		_mm256_storeu_ps(data + k, kernel(params, k)); \
+	} \
+	if (k < end) { \
+		float tail[8]; \
+		_mm256_storeu_ps(tail, kernel(params, k)); \
+		memcpy(data + k, tail, (end - k) * sizeof(float)); \
+	} \
+}
+
+AVX2_FILL_RANGE(uniformAvx2, uniform8)
+AVX2_FILL_RANGE(normalAvx2, normal8)
+AVX2_FILL_RANGE(edgeCasesAvx2, edgeCases8)
+#endif
+
+bool simdFillSupported() {
+#ifdef AUTOTESTS_X86
+	static bool supported = cpuHasAvx2();
+	return supported;
+#else
+	return false;
+#endif
+}
+
+typedef void (*FillRange)(const FillParams& params, float* data, size_t begin, size_t end);
+
+// Splits [0, count) between hardware threads in multiples of 64 elements; small fills, and
+// fills with parallel disabled, stay on the calling thread
+static void parallelFill(bool parallel, const FillParams& params, float* data, size_t count, FillRange fillRange) {
+	const size_t minChunk = 1 << 16;
+	size_t threadCount = parallel ? thread::hardware_concurrency() : 1;
+	if (threadCount > count / minChunk) {
+		threadCount = count / minChunk;
+	}
+	if (threadCount <= 1) {
+		fillRange(params, data, 0, count);
+		return;
+	}
+	size_t chunk = (count / threadCount + 63) & ~(size_t)63;
+	vector<thread> workers;
+	for (size_t begin = chunk; begin < count; begin += chunk) {
+		workers.emplace_back(fillRange, cref(params), data, begin, begin + chunk < count ? begin + chunk : count);
+	}
+	fillRange(params, data, 0, chunk);
+	for (auto& worker : workers) {
+		worker.join();
+	}
+}
+
+TestDataGenerator::TestDataGenerator(uint64_t seed) : seed(seed), simd(simdFillSupported()) {}
+
+static FillParams fillParams(uint64_t seed, uint64_t stream, float offset, float scale) {
+	uint64_t key = mixCounter(seed, stream);
+	FillParams params = { (uint32_t)key, (uint32_t)(key >> 32), offset, scale };
+	return params;
+}
+
+void TestDataGenerator::FillUniform(float* data, size_t count, float low, float high) {
+	FillParams params = fillParams(seed, stream++, low, high - low);
+#ifdef AUTOTESTS_X86
+	if (simd) {
+		parallelFill(parallel, params, data, count, uniformAvx2);
+		return;
+	}
+#endif
+	parallelFill(parallel, params, data, count, uniformScalar);
+}
+
+void TestDataGenerator::FillNormal(float* data, size_t count, float mean, float deviation) {
+	FillParams params = fillParams(seed, stream++, mean, deviation);
+#ifdef AUTOTESTS_X86
+	if (simd) {
+		parallelFill(parallel, params, data, count, normalAvx2);
+		return;
+	}
+#endif
+	parallelFill(parallel, params, data, count, normalScalar);
+}
+
+void TestDataGenerator::FillEdgeCases(float* data, size_t count) {
+	FillParams params = fillParams(seed, stream++, 0, 1);
+#ifdef AUTOTESTS_X86
+	if (simd) {
+		parallelFill(parallel, params, data, count, edgeCasesAvx2);
+		return;
+	}
+#endif
+	parallelFill(parallel, params, data, count, edgeCasesScalar);
+}
+
+void logTestMetric(const string& name, double value, const string& unit) {
+	logFile << name << " - " << value << (unit.empty() ? "" : " ") << unit << endl;
+	::testing::Test::RecordProperty(name, to_string(value));
+}
+
+void logTestNote(const string& name, const string& text) {
+	logFile << name << " - " << text << endl;
+	::testing::Test::RecordProperty(name, text);
+}
+
+LatencyHistogram::LatencyHistogram() : counts(new atomic<uint64_t>[bucketCount]) {
+	Reset();
+}
+
+int LatencyHistogram::BucketIndex(uint64_t value) {
+	if (value < (1u << subBucketBits)) {
+		return (int)value;
+	}
+	int highestBit = 0;
+	for (int shift = 32; shift; shift >>= 1) {
+		if (value >> (highestBit + shift)) {
+			highestBit += shift;
+		}
+	}
+	int magnitude = highestBit - subBucketBits + 1;
+	return magnitude * subBucketHalf + (int)(value >> magnitude);
+}
+
+uint64_t LatencyHistogram::BucketHighestValue(int index) {
+	if (index < (1 << subBucketBits)) {
+		return index;
+	}
+	int magnitude = index / subBucketHalf - 1;
+	uint64_t subBucket = index - magnitude * subBucketHalf;
+	return ((subBucket + 1) << magnitude) - 1;
+}
+
+void LatencyHistogram::UpdateMax(uint64_t value) {
+	uint64_t current = maxValue.load(memory_order_relaxed);
+	while (value > current && !maxValue.compare_exchange_weak(current, value, memory_order_relaxed)) {
+	}
+}
+
+void LatencyHistogram::Record(uint64_t nanoseconds) {
+	counts[BucketIndex(nanoseconds)].fetch_add(1, memory_order_relaxed);
+	total.fetch_add(1, memory_order_relaxed);
+	sum.fetch_add(nanoseconds, memory_order_relaxed);
+	UpdateMax(nanoseconds);
+}
+
+void LatencyHistogram::Record(chrono::steady_clock::duration elapsed) {
+	Record((uint64_t)chrono::duration_cast<chrono::nanoseconds>(elapsed).count());
+}
+
+uint64_t LatencyHistogram::Count() const {
+	return total.load(memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::Max() const {
+	return maxValue.load(memory_order_relaxed);
+}
+
+double LatencyHistogram::Mean() const {
+	uint64_t count = Count();
+	return count ? (double)sum.load(memory_order_relaxed) / count : 0;
+}
+
+uint64_t LatencyHistogram::Percentile(double percentile) const {
+	uint64_t count = Count();
+	if (!count) {
+		return 0;
+	}
+	uint64_t target = (uint64_t)ceil(percentile / 100 * count);
+	target = target ? target : 1;
+	uint64_t seen = 0;
+	for (int i = 0; i < bucketCount; i++) {
+		seen += counts[i].load(memory_order_relaxed);
+		if (seen >= target) {
+			uint64_t value = BucketHighestValue(i);
+			return value < Max() ? value : Max();
+		}
+	}
+	return Max();
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+	for (int i = 0; i < bucketCount; i++) {
+		uint64_t count = other.counts[i].load(memory_order_relaxed);
+		if (count) {
+			counts[i].fetch_add(count, memory_order_relaxed);
+		}
+	}
+	total.fetch_add(other.total.load(memory_order_relaxed), memory_order_relaxed);
+	sum.fetch_add(other.sum.load(memory_order_relaxed), memory_order_relaxed);
+	UpdateMax(other.Max());
+}
+
+void LatencyHistogram::Dump(ostream& out) const {
+	out << "histogram " << subBucketBits << " " << Count() << " " << sum.load(memory_order_relaxed) << " " << Max();
+	for (int i = 0; i < bucketCount; i++) {
+		uint64_t count = counts[i].load(memory_order_relaxed);
+		if (count) {
+			out << " " << i << ":" << count;
+		}
+	}
+}
+
+bool LatencyHistogram::Load(istream& in) {
+	string tag;
+	int bits = 0;
+	uint64_t count = 0, valueSum = 0, value = 0;
+	if (!(in >> tag >> bits >> count >> valueSum >> value) || tag != "histogram" || bits != subBucketBits) {
+		return false;
+	}
+	string line;
+	getline(in, line);
+	istringstream buckets(line);
+	int index;
+	char separator;
+	uint64_t bucketCountValue;
+	while (buckets >> index >> separator >> bucketCountValue) {
+		if (index < 0 || index >= bucketCount) {
+			return false;
+		}
+		counts[index].fetch_add(bucketCountValue, memory_order_relaxed);
+	}
+	total.fetch_add(count, memory_order_relaxed);
+	sum.fetch_add(valueSum, memory_order_relaxed);
+	UpdateMax(value);
+	return true;
+}
+
+void LatencyHistogram::Reset() {
+	for (int i = 0; i < bucketCount; i++) {
+		counts[i].store(0, memory_order_relaxed);
+	}
+	total.store(0, memory_order_relaxed);
+	sum.store(0, memory_order_relaxed);
+	maxValue.store(0, memory_order_relaxed);
+}
+
+void logLatencyHistogram(const string& name, const LatencyHistogram& histogram) {
+	logTestMetric(name + " count", (double)histogram.Count(), "");
+	logTestMetric(name + " p50", histogram.Percentile(50) / 1000.0, "us");
+	logTestMetric(name + " p90", histogram.Percentile(90) / 1000.0, "us");
+	logTestMetric(name + " p99", histogram.Percentile(99) / 1000.0, "us");
+	logTestMetric(name + " p99.9", histogram.Percentile(99.9) / 1000.0, "us");
+	logTestMetric(name + " max", histogram.Max() / 1000.0, "us");
+	logFile << name << " dump - ";
+	histogram.Dump(logFile);
+	logFile << endl;
+}
+
+const char* hostAllocationStrategyName(HostAllocationStrategy strategy) {
+	switch (strategy) {
+	case HOST_ALLOC_MALLOC:
+		return "malloc";
+	case HOST_ALLOC_ALIGNED_4K:
+		return "4K aligned";
+	case HOST_ALLOC_HUGE_PAGES:
+		return "2MB huge pages";
+	case HOST_ALLOC_PINNED:
+		return "pinned";
+	case HOST_ALLOC_AMF:
+		return "AMF host buffer";
+	default:
+		return "unknown";
+	}
+}
+
+#ifdef __linux__
+// AnonHugePages of the mapping that contains address, from /proc/self/smaps
+static size_t anonHugePageBytes(void* address) {
+	ifstream smaps("/proc/self/smaps");
+	string line;
+	bool inMapping = false;
+	while (getline(smaps, line)) {
+		uintptr_t start, end;
+		char dash;
+		istringstream range(line);
+		if (range >> hex >> start >> dash >> end && dash == '-') {
+			inMapping = start <= (uintptr_t)address && (uintptr_t)address < end;
+		}
+		else if (inMapping && line.compare(0, 14, "AnonHugePages:") == 0) {
+			return stoull(line.substr(14)) * 1024;
+		}
+	}
+	return 0;
+}
+#endif
+
+HostAllocation::HostAllocation(HostAllocationStrategy strategy, size_t size, AMFContext* context) : strategy(strategy), size(size) {
+	switch (strategy) {
+	case HOST_ALLOC_MALLOC:
+		data = malloc(size);
+		detail = "malloc";
+		break;
+	case HOST_ALLOC_ALIGNED_4K:
+#ifdef _WIN32
+		data = _aligned_malloc(size, 4096);
+#else
+		if (posix_memalign(&data, 4096, size)) {
+			data = nullptr;
+		}
+#endif
+		detail = "4K aligned";
+		break;
+	case HOST_ALLOC_HUGE_PAGES: {
+#ifdef _WIN32
+		// Large pages need SeLockMemoryPrivilege and a size rounded to the large page minimum
+		size_t largePage = GetLargePageMinimum();
+		if (largePage) {
+			this->size = (size + largePage - 1) & ~(largePage - 1);
+			data = VirtualAlloc(NULL, this->size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+			detail = "explicit large pages";
+		}
+		if (!data) {
+			this->size = size;
+			data = VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+			detail = "normal pages, large pages unavailable";
+		}
+#elif defined(__linux__)
+		const size_t hugePage = 2 * 1024 * 1024;
+		this->size = (size + hugePage - 1) & ~(hugePage - 1);
+		data = mmap(NULL, this->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (21 << MAP_HUGE_SHIFT), -1, 0);
+		detail = "explicit huge pages";
+		if (data == MAP_FAILED) {
+			// Transparent huge pages only back 2MB-aligned ranges, so map one page extra and trim to alignment
+			data = nullptr;
+			char* mapping = (char*)mmap(NULL, this->size + hugePage, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (mapping != MAP_FAILED) {
+				char* aligned = (char*)(((uintptr_t)mapping + hugePage - 1) & ~(uintptr_t)(hugePage - 1));
+				if (aligned > mapping) {
+					munmap(mapping, aligned - mapping);
+				}
+				munmap(aligned + this->size, mapping + hugePage - aligned);
+				data = aligned;
+			}
+			detail = "normal pages, huge pages unavailable";
+			if (data && madvise(data, this->size, MADV_HUGEPAGE) == 0) {
+				// madvise succeeds even when THP is disabled, so fault the range in and ask the kernel what it got
+				for (size_t offset = 0; offset < this->size; offset += hugePage) {
+					((volatile char*)data)[offset] = 0;
+				}
+				size_t hugeBytes = anonHugePageBytes(data);
+				if (hugeBytes >= this->size) {
+					detail = "transparent huge pages";
+				}
+				else if (hugeBytes) {
+					detail = "partly transparent huge pages, " + to_string(hugeBytes >> 20) + " of " + to_string(this->size >> 20) + " MB";
+				}
+				else {
+					detail = "normal pages, transparent huge pages not granted";
+				}
+			}
+		}
+#endif
+		break;
+	}
+	case HOST_ALLOC_PINNED: {
+#ifdef _WIN32
+		data = VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+		// The working set has to fit the locked range, otherwise VirtualLock fails
+		SIZE_T minimumSet, maximumSet;
+		if (data && GetProcessWorkingSetSize(GetCurrentProcess(), &minimumSet, &maximumSet)
+			&& SetProcessWorkingSetSize(GetCurrentProcess(), minimumSet + size, maximumSet + size)) {
+			previousMinimumWorkingSet = minimumSet;
+			previousMaximumWorkingSet = maximumSet;
+		}
+		detail = data && VirtualLock(data, size) ? "locked" : "unlocked, VirtualLock failed";
+#elif defined(__linux__)
+		data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (data == MAP_FAILED) {
+			data = nullptr;
+		}
+		detail = data && mlock(data, size) == 0 ? "locked" : "unlocked, mlock failed";
+#endif
+		break;
+	}
+	case HOST_ALLOC_AMF:
+		if (context && context->AllocBuffer(AMF_MEMORY_HOST, size, &amfBuffer) == AMF_OK) {
+			data = amfBuffer->GetNative();
+		}
+		detail = "AMF_MEMORY_HOST buffer";
+		break;
+	default:
+		break;
+	}
+}
+
+HostAllocation::~HostAllocation() {
+	if (!data) {
+		return;
+	}
+	switch (strategy) {
+	case HOST_ALLOC_MALLOC:
+		free(data);
+		break;
+	case HOST_ALLOC_ALIGNED_4K:
+#ifdef _WIN32
+		_aligned_free(data);
+#else
+		free(data);
+#endif
+		break;
+	case HOST_ALLOC_HUGE_PAGES:
+	case HOST_ALLOC_PINNED:
+#ifdef _WIN32
+		if (strategy == HOST_ALLOC_PINNED) {
+			VirtualUnlock(data, size);
+		}
+		VirtualFree(data, 0, MEM_RELEASE);
+		if (previousMaximumWorkingSet) {
+			SetProcessWorkingSetSize(GetCurrentProcess(), previousMinimumWorkingSet, previousMaximumWorkingSet);
+		}
+#elif defined(__linux__)
+		if (strategy == HOST_ALLOC_PINNED) {
+			munlock(data, size);
+		}
+		munmap(data, size);
+#endif
+		break;
+	default:
+		break;
+	}
+}
+
+ProcessResources currentProcessResources() {
+	ProcessResources resources;
+#ifdef _WIN32
+	DWORD handles = 0;
+	GetProcessHandleCount(GetCurrentProcess(), &handles);
+	resources.handles = handles;
+	HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
+	PROCESSENTRY32 entry = {};
+	entry.dwSize = sizeof(entry);
+	for (BOOL found = Process32First(snapshot, &entry); found; found = Process32Next(snapshot, &entry)) {
+		if (entry.th32ProcessID == GetCurrentProcessId()) {
+			resources.threads = entry.cntThreads;
+		}
+	}
+	CloseHandle(snapshot);
+#elif defined(__linux__)
+	if (DIR* fds = opendir("/proc/self/fd")) {
+		while (dirent* fd = readdir(fds)) {
+			resources.handles += fd->d_name[0] != '.';
+		}
+		closedir(fds);
+	}
+	ifstream status("/proc/self/status");
+	string line;
+	while (getline(status, line)) {
+		if (line.compare(0, 8, "Threads:") == 0) {
+			resources.threads = stoul(line.substr(8));
+		}
+	}
+#endif
+	return resources;
+}
+
+double soakDurationSeconds() {
+	const char* env = getenv("AMF_AUTOTESTS_SOAK_SECONDS");
+	return env ? atof(env) : 0;
+}
+
+double soakIntervalSeconds() {
+	const char* env = getenv("AMF_AUTOTESTS_SOAK_INTERVAL");
+	return env ? atof(env) : 10;
+}
+
+double trendSlope(const vector<double>& seconds, const vector<double>& values, double& correlation) {
+	double n = (double)seconds.size();
+	double meanX = 0, meanY = 0;
+	for (size_t i = 0; i < seconds.size(); i++) {
+		meanX += seconds[i] / n;
+		meanY += values[i] / n;
+	}
+	double covariance = 0, varianceX = 0, varianceY = 0;
+	for (size_t i = 0; i < seconds.size(); i++) {
+		covariance += (seconds[i] - meanX) * (values[i] - meanY);
+		varianceX += (seconds[i] - meanX) * (seconds[i] - meanX);
+		varianceY += (values[i] - meanY) * (values[i] - meanY);
+	}
+	correlation = varianceX > 0 && varianceY > 0 ? covariance / sqrt(varianceX * varianceY) : 0;
+	return varianceX > 0 ? covariance / varianceX : 0;
+}
+
+string soakDrift(const vector<SoakSample>& samples) {
+	// The first sample includes warm-up (kernel compilation, pool growth) and is not a trend
+	const double minCorrelation = 0.8;
+	const double maxGrowth = 0.1;
+	if (samples.size() < soakMinSamples) {
+		return "only " + to_string(samples.size()) + " samples, " + to_string(soakMinSamples)
+			+ " are needed to detect drift; raise AMF_AUTOTESTS_SOAK_SECONDS or lower AMF_AUTOTESTS_SOAK_INTERVAL";
+	}
+	vector<double> seconds;
+	vector<pair<string, vector<double>>> series = {
+		{ "Latency p99", {} }, { "Host memory", {} }, { "Host pointers", {} },
+		{ "Device memory", {} }, { "Handles", {} }, { "Threads", {} }
+	};
+	for (size_t i = 1; i < samples.size(); i++) {
+		seconds.push_back(samples[i].seconds);
+		series[0].second.push_back(samples[i].latencyP99);
+		series[1].second.push_back(samples[i].hostMemory);
+		series[2].second.push_back(samples[i].hostPointers);
+		series[3].second.push_back((double)samples[i].deviceMemory);
+		series[4].second.push_back(samples[i].resources.handles);
+		series[5].second.push_back(samples[i].resources.threads);
+	}
+	string drift;
+	double span = seconds.back() - seconds.front();
+	for (auto& values : series) {
+		double correlation;
+		double slope = trendSlope(seconds, values.second, correlation);
+		logTestMetric(values.first + " slope", slope, "per s");
+		double baseline = values.second.front() > 1.0 ? values.second.front() : 1.0;
+		if (slope > 0 && correlation >= minCorrelation && slope * span / baseline > maxGrowth) {
+			drift += values.first + " grows by " + to_string(slope) + " per s (r = " + to_string(correlation) + "); ";
+		}
+	}
+	return drift;
+}
+
+string logSoakSummary(const vector<SoakSample>& samples, const LatencyHistogram& latencies) {
+	logFile.open("out.log", ios::out | ios::app);
+	logFile
+		<< "Soak summary:" << endl
+		<< "Soak samples - " << samples.size() << endl;
+	logLatencyHistogram("Soak latency", latencies);
+	string drift = soakDrift(samples);
+	logFile
+		<< "Soak drift - " << (drift.empty() ? "none" : drift) << endl
+		<< "----------------------------------------------------------" << endl;
+	logFile.close();
+	return drift;
 }
 
 bool has_suffix(const string& str, const string& suffix)
@@ -59,6 +984,8 @@ void initiateTestSuiteLog(string suiteName) {
 		<< spaces << suiteName << endl
 		<< "|--------------------------------------------------------|" << endl;
 	logFile.close();
+	// Open the counters before the fixtures start AMF runtime threads, so they inherit them
+	startPerfCounters();
 }
 
 chrono::time_point<chrono::system_clock> initiateTestLog() {
@@ -70,11 +997,15 @@ chrono::time_point<chrono::system_clock> initiateTestLog() {
 		<< "Time: " << std::ctime(&convertedTime) << endl
 		<< "Memory metrics before test:" << endl
 		<< "Memory usage - " << memoryUsage.CurrentUsage() << endl
-		<< "Pointers count - " << memoryUsage.CurrentPointers() << endl;
+		<< "Pointers count - " << memoryUsage.CurrentPointers() << endl
+		<< "Test data seed - " << testDataSeed() << endl;
+	subsystemInits.clear();
+	startPerfCounters();
 	return startTime;
 }
 
 void terminateTestLog(chrono::time_point<chrono::system_clock> startTime) {
+	PerfCounters counters = stopPerfCounters();
 	auto endTime = chrono::system_clock::now();
 	chrono::duration<double> elapsed_seconds = endTime - startTime;
 	logFile
@@ -82,6 +1013,27 @@ void terminateTestLog(chrono::time_point<chrono::system_clock> startTime) {
 		<< "Memory metrics after test:" << endl
 		<< "Memory usage - " << memoryUsage.CurrentUsage() << endl
 		<< "Pointers count - " << memoryUsage.CurrentPointers() << endl
+		<< "AMF subsystems initialized:" << (subsystemInits.empty() ? " none" : "") << endl;
+	for (auto& init : subsystemInits) {
+		logFile << init.first << " - " << init.second.count() << " s" << endl;
+	}
+	bool anyCounter = false;
+	for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+		anyCounter |= counters.available[i];
+	}
+	if (anyCounter) {
+		logFile << "Performance counters:" << endl;
+		for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+			logFile << perfCounterNames[i] << " - ";
+			if (counters.available[i]) {
+				logFile << counters.values[i] << endl;
+			}
+			else {
+				logFile << "n/a" << endl;
+			}
+		}
+	}
+	logFile
 		<< "----------------------------------------------------------" << endl;
 	logFile.close();
 }
@@ -93,4 +1045,44 @@ void terminateTestSuiteLog() {
 		<< endl;
 	logFile.close();
 }
+
+OpenCLFixture::OpenCLFixture() :
+	factory("AMF factory", [this](AMFFactory*& value) {
+		helper.Init();
+		value = helper.GetFactory();
+	}),
+	context1("OpenCL context", [this](AMFContextPtr& value) {
+		factory->CreateContext(&value);
+		value->SetProperty(AMF_CONTEXT_DEVICE_TYPE, AMF_CONTEXT_DEVICE_TYPE_GPU);
+		value->InitOpenCL();
+	}),
+	oclComputeFactory("OpenCL compute factory", [this](AMFComputeFactoryPtr& value) {
+		context1->GetOpenCLComputeFactory(&value);
+	}),
+	device("OpenCL compute device", [this](AMFComputeDevicePtr& value) {
+		oclComputeFactory->GetDeviceAt(0, &value);
+	}),
+	compute("OpenCL compute", [this](AMFComputePtr& value) {
+		device->CreateCompute(nullptr, &value);
+	}),
+	amfRuntime("AMF runtime", [](AMFFactoryHelper*& value) {
+		g_AMFFactory.Init();
+		value = &g_AMFFactory;
+	}) {
+	startTime = initiateTestLog();
+}
+
+OpenCLFixture::~OpenCLFixture() {
+	compute.value.Release();
+	device.value.Release();
+	context1.value.Release();
+	oclComputeFactory.value.Release();
+	if (amfRuntime.initialized) {
+		g_AMFFactory.Terminate();
+	}
+	if (factory.initialized) {
+		helper.Terminate();
+	}
+	terminateTestLog(startTime);
+}
 #endif
@@ -7,9 +7,19 @@
 #include <gtest/gtest.h>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <string>
 #include <chrono>
 #include <ctime>  
+#include <functional>
+#include <vector>
+#include <thread>
+#include <limits>
+#include <cfloat>
+#include <atomic>
+#include <memory>
+#include <cstdlib>
+#include <cmath>
 using namespace std;
 using namespace amf;
 
@@ -17,20 +27,231 @@ using namespace amf;
 
 struct TestsInformation;
 
+// Updated from every thread that allocates, so the counters are relaxed atomics
 struct AllocationMetrics {
-	uint32_t totalAllocated = 0;
-	uint32_t totalFreed = 0;
-	uint32_t totalPointersMade = 0;
-	uint32_t totalPointersDestroyed = 0;
+	atomic<uint32_t> totalAllocated{ 0 };
+	atomic<uint32_t> totalFreed{ 0 };
+	atomic<uint32_t> totalPointersMade{ 0 };
+	atomic<uint32_t> totalPointersDestroyed{ 0 };
 
 	uint32_t CurrentUsage();
 
 	uint32_t CurrentPointers();
 };
 
+extern AllocationMetrics memoryUsage;
+
+enum PerfCounterId {
+	PERF_CYCLES,
+	PERF_INSTRUCTIONS,
+	PERF_CACHE_MISSES,
+	PERF_BRANCH_MISSES,
+	PERF_CONTEXT_SWITCHES,
+	PERF_PAGE_FAULTS,
+	PERF_COUNTER_COUNT
+};
+
+// Hardware/software counters for one test window. Collected through perf_event_open on Linux
+// when AMF_AUTOTESTS_PERF_COUNTERS is set, otherwise every counter stays unavailable.
+struct PerfCounters {
+	uint64_t values[PERF_COUNTER_COUNT] = {};
+	bool available[PERF_COUNTER_COUNT] = {};
+};
+
+void startPerfCounters();
+
+PerfCounters stopPerfCounters();
+
+void recordSubsystemInit(const string& name, chrono::duration<double> cost);
+
+chrono::duration<double> subsystemInitTotal();
+
+// Fixture resource created on first use, so tests only pay for the AMF subsystems they touch.
+// The cost of creation, excluding nested resources it pulls in, is listed in the test log.
+template<typename T>
+struct LazyResource {
+	string name;
+	function<void(T&)> create;
+	T value = T();
+	bool initialized = false;
+	chrono::duration<double> cost = chrono::duration<double>::zero();
+
+	LazyResource(string name, function<void(T&)> create) : name(name), create(create) {}
+
+	T& Get() {
+		if (!initialized) {
+			initialized = true;
+			chrono::duration<double> nestedBefore = subsystemInitTotal();
+			auto startTime = chrono::steady_clock::now();
+			create(value);
+			cost = chrono::steady_clock::now() - startTime - (subsystemInitTotal() - nestedBefore);
+			recordSubsystemInit(name, cost);
+		}
+		return value;
+	}
+
+	T& operator->() {
+		return Get();
+	}
+};
+
+uint64_t testDataSeed();
+
+bool simdFillSupported();
+
+// Counter-based test data generator: element k of a fill depends only on the seed, the fill
+// index and k, so results do not depend on how the range is split between threads. Fills run
+// AVX2 kernels where the CPU supports them and scalar loops performing the same operations otherwise.
+struct TestDataGenerator {
+	uint64_t seed;
+	uint64_t stream = 0;
+	bool simd;
+	bool parallel = true;
+
+	TestDataGenerator(uint64_t seed = testDataSeed());
+
+	void FillUniform(float* data, size_t count, float low, float high);
+
+	void FillNormal(float* data, size_t count, float mean, float deviation);
+
+	// Mixes zeros, denormals, infinities, NaN and range limits into ordinary values
+	void FillEdgeCases(float* data, size_t count);
+};
+
+void logTestMetric(const string& name, double value, const string& unit);
+
+void logTestNote(const string& name, const string& text);
+
+// Lock-free log-linear histogram in fixed memory, in the style of HdrHistogram. Values are
+// nanoseconds; values below 256 are exact and larger ones are kept within 1/128 of their value.
+// Record may be called from any number of threads at once. Buckets are allocated once on the
+// heap so that several histograms fit on a test's stack.
+class LatencyHistogram {
+public:
+	static const int subBucketBits = 8;
+	static const int subBucketHalf = 1 << (subBucketBits - 1);
+	static const int bucketCount = (64 - subBucketBits + 2) * subBucketHalf;
+
+	LatencyHistogram();
+
+	LatencyHistogram(const LatencyHistogram&) = delete;
+
+	LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+	void Record(uint64_t nanoseconds);
+
+	void Record(chrono::steady_clock::duration elapsed);
+
+	uint64_t Count() const;
+
+	uint64_t Max() const;
+
+	double Mean() const;
+
+	// Highest value equivalent to the given percentile (0..100), in nanoseconds
+	uint64_t Percentile(double percentile) const;
+
+	void Merge(const LatencyHistogram& other);
+
+	// Single-line text form that Load can merge back, e.g. from dumps of several runs
+	void Dump(ostream& out) const;
+
+	bool Load(istream& in);
+
+	void Reset();
+
+private:
+	unique_ptr<atomic<uint64_t>[]> counts;
+	atomic<uint64_t> total;
+	atomic<uint64_t> sum;
+	atomic<uint64_t> maxValue;
+
+	static int BucketIndex(uint64_t value);
+
+	static uint64_t BucketHighestValue(int index);
+
+	void UpdateMax(uint64_t value);
+};
+
+// Writes p50/p90/p99/p99.9/max in microseconds and the histogram dump to the test log
+void logLatencyHistogram(const string& name, const LatencyHistogram& histogram);
+
+enum HostAllocationStrategy {
+	HOST_ALLOC_MALLOC,
+	HOST_ALLOC_ALIGNED_4K,
+	HOST_ALLOC_HUGE_PAGES,
+	HOST_ALLOC_PINNED,
+	HOST_ALLOC_AMF,
+	HOST_ALLOC_COUNT
+};
+
+// Host staging memory taken from one allocation strategy and released on destruction.
+// Huge pages fall back to transparent huge pages and then to normal pages, pinning falls back to
+// unlocked pages; detail says what was actually obtained. HOST_ALLOC_AMF needs a context.
+struct HostAllocation {
+	HostAllocationStrategy strategy;
+	size_t size;
+	void* data = nullptr;
+	string detail;
+	AMFBufferPtr amfBuffer;
+	// Working-set limits in effect before a pinned allocation raised them, zero when unchanged
+	size_t previousMinimumWorkingSet = 0;
+	size_t previousMaximumWorkingSet = 0;
+
+	HostAllocation(HostAllocationStrategy strategy, size_t size, AMFContext* context = nullptr);
+
+	HostAllocation(const HostAllocation&) = delete;
+
+	HostAllocation& operator=(const HostAllocation&) = delete;
+
+	~HostAllocation();
+};
+
+const char* hostAllocationStrategyName(HostAllocationStrategy strategy);
+
+struct ProcessResources {
+	uint32_t handles = 0;
+	uint32_t threads = 0;
+};
+
+ProcessResources currentProcessResources();
+
+struct SoakSample {
+	double seconds = 0;
+	uint64_t operations = 0;
+	double latencyP50 = 0;
+	double latencyP99 = 0;
+	double latencyMax = 0;
+	uint32_t hostMemory = 0;
+	uint32_t hostPointers = 0;
+	uint64_t deviceMemory = 0;
+	ProcessResources resources;
+};
+
+// Soak mode is enabled by AMF_AUTOTESTS_SOAK_SECONDS and repeats the tests selected by
+// --gtest_filter; samples are taken every AMF_AUTOTESTS_SOAK_INTERVAL seconds (10 by default)
+double soakDurationSeconds();
+
+double soakIntervalSeconds();
+
+// Drift needs a trend after the warm-up sample, so fewer samples fail the soak
+const size_t soakMinSamples = 6;
+
+// Least-squares slope of values over seconds; correlation receives Pearson's r
+double trendSlope(const vector<double>& seconds, const vector<double>& values, double& correlation);
+
+// Describes every series that grows steadily over the soak, or why there are too few samples
+// to tell; empty when nothing drifts
+string soakDrift(const vector<SoakSample>& samples);
+
+// Writes the soak latencies and drift slopes to out.log and returns soakDrift
+string logSoakSummary(const vector<SoakSample>& samples, const LatencyHistogram& latencies);
+
 void* operator new(size_t size);
 
-void operator delete(void* memory, size_t size);
+void operator delete(void* memory) noexcept;
+
+void operator delete(void* memory, size_t size) noexcept;
 
 bool has_suffix(const string& str, const string& suffix);
 
@@ -42,7 +263,27 @@ void terminateTestLog(chrono::time_point<chrono::system_clock> startTime);
 
 void terminateTestSuiteLog();
 
+// Shared by the suites that run on an OpenCL context; each resource is created on first use.
+// Suites derive from it and keep their own SetUpTestCase/TearDownTestCase for the suite log.
+struct OpenCLFixture : testing::Test {
+	AMFFactoryHelper helper;
+	LazyResource<AMFFactory*> factory;
+	LazyResource<AMFContextPtr> context1;
+	LazyResource<AMFComputeFactoryPtr> oclComputeFactory;
+	LazyResource<AMFComputeDevicePtr> device;
+	LazyResource<AMFComputePtr> compute;
+	// g_AMFFactory, for tests that go through the global runtime instead of helper
+	LazyResource<AMFFactoryHelper*> amfRuntime;
+	chrono::time_point<chrono::system_clock> startTime;
+
+	OpenCLFixture();
+
+	~OpenCLFixture();
+};
+
+#ifdef _MSC_VER
 int allocationHook(int allocType, void* userData, std::size_t size, int blockType, long requestNumber,
 	const unsigned char* filename, int lineNumber);
+#endif
 
 #endif
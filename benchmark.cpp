@@ -0,0 +1,346 @@
+#include "autotests.h"
+#include <CL/cl.h>
+
+struct Benchmark : OpenCLFixture {
+	static void SetUpTestCase() {
+		initiateTestSuiteLog("Benchmark");
+	}
+
+	static void TearDownTestCase() {
+		terminateTestSuiteLog();
+	}
+};
+
+TEST_F(Benchmark, testData_fillThroughput) {
+	const size_t count = 1 << 22;
+	const double megabytes = count * sizeof(float) / 1048576.0;
+	vector<float> randData(count);
+	vector<float> generatedData(count);
+
+	auto randStart = chrono::steady_clock::now();
+	for (size_t k = 0; k < count; k++)
+	{
+		randData[k] = rand() / 50.00;
+	}
+	chrono::duration<double> randTime = chrono::steady_clock::now() - randStart;
+
+	TestDataGenerator generator;
+	auto generatorStart = chrono::steady_clock::now();
+	generator.FillUniform(generatedData.data(), count, 0.0f, 655.0f);
+	chrono::duration<double> generatorTime = chrono::steady_clock::now() - generatorStart;
+
+	// Single-threaded scalar fill of the same seed, both as the reference and for its throughput
+	TestDataGenerator reference(generator.seed);
+	reference.simd = false;
+	reference.parallel = false;
+	vector<float> referenceData(count);
+	auto referenceStart = chrono::steady_clock::now();
+	reference.FillUniform(referenceData.data(), count, 0.0f, 655.0f);
+	chrono::duration<double> referenceTime = chrono::steady_clock::now() - referenceStart;
+
+	TestDataGenerator singleThread(generator.seed);
+	singleThread.parallel = false;
+	vector<float> singleThreadData(count);
+	auto singleThreadStart = chrono::steady_clock::now();
+	singleThread.FillUniform(singleThreadData.data(), count, 0.0f, 655.0f);
+	chrono::duration<double> singleThreadTime = chrono::steady_clock::now() - singleThreadStart;
+
+	logTestNote("TestDataGenerator SIMD", generator.simd ? "AVX2" : "unsupported, scalar");
+	logTestMetric("rand() fill", megabytes / randTime.count(), "MB/s");
+	logTestMetric("TestDataGenerator uniform fill, scalar, 1 thread", megabytes / referenceTime.count(), "MB/s");
+	logTestMetric("TestDataGenerator uniform fill, 1 thread", megabytes / singleThreadTime.count(), "MB/s");
+	logTestMetric("TestDataGenerator uniform fill, all threads", megabytes / generatorTime.count(), "MB/s");
+
+	// Threads and SIMD must not change a single bit of the output
+	EXPECT_EQ(memcmp(referenceData.data(), generatedData.data(), count * sizeof(float)), 0);
+	EXPECT_EQ(memcmp(referenceData.data(), singleThreadData.data(), count * sizeof(float)), 0);
+}
+
+TEST_F(Benchmark, testData_distributions) {
+	const size_t count = 1 << 20;
+	vector<float> data(count);
+	TestDataGenerator generator;
+
+	generator.FillNormal(data.data(), count, 0.0f, 1.0f);
+	double sum = 0;
+	double squares = 0;
+	for (float value : data)
+	{
+		sum += value;
+		squares += value * value;
+	}
+	EXPECT_LE(abs(sum / count), 0.01);
+	EXPECT_LE(abs(squares / count - 1.0), 0.01);
+
+	generator.FillEdgeCases(data.data(), count);
+	size_t nans = 0;
+	size_t infinities = 0;
+	size_t denormals = 0;
+	for (float value : data)
+	{
+		nans += isnan(value);
+		infinities += isinf(value);
+		denormals += fpclassify(value) == FP_SUBNORMAL;
+	}
+	EXPECT_GT(nans, 0u);
+	EXPECT_GT(infinities, 0u);
+	EXPECT_GT(denormals, 0u);
+
+	// The scalar single-threaded path reproduces both fills bit for bit
+	TestDataGenerator reference(generator.seed);
+	reference.simd = false;
+	reference.parallel = false;
+	vector<float> referenceData(count);
+	vector<float> normalData(count);
+	TestDataGenerator normal(generator.seed);
+	normal.FillNormal(normalData.data(), count, 0.0f, 1.0f);
+	reference.FillNormal(referenceData.data(), count, 0.0f, 1.0f);
+	EXPECT_EQ(memcmp(referenceData.data(), normalData.data(), count * sizeof(float)), 0);
+	reference.FillEdgeCases(referenceData.data(), count);
+	EXPECT_EQ(memcmp(referenceData.data(), data.data(), count * sizeof(float)), 0);
+}
+
+TEST_F(Benchmark, latencyHistogram_percentiles) {
+	LatencyHistogram histogram;
+	vector<thread> workers;
+	for (int t = 0; t < 4; t++) {
+		workers.emplace_back([&histogram]() {
+			for (uint64_t value = 1; value <= 250000; value++) {
+				histogram.Record(value * 1000);
+			}
+		});
+	}
+	for (auto& worker : workers) {
+		worker.join();
+	}
+	EXPECT_EQ(histogram.Count(), 1000000u);
+	EXPECT_EQ(histogram.Max(), 250000000u);
+	EXPECT_LE(abs((double)histogram.Percentile(50) - 125000000) / 125000000, 1.0 / 128);
+	EXPECT_LE(abs((double)histogram.Percentile(99) - 247500000) / 247500000, 1.0 / 128);
+
+	stringstream dump;
+	histogram.Dump(dump);
+	LatencyHistogram merged;
+	merged.Record(1);
+	EXPECT_TRUE(merged.Load(dump));
+	EXPECT_EQ(merged.Count(), histogram.Count() + 1);
+	EXPECT_EQ(merged.Percentile(99.9), histogram.Percentile(99.9));
+	logLatencyHistogram("Synthetic", merged);
+}
+
+TEST_F(Benchmark, amfVsNative_overhead) {
+	const int count = 1024 * 1024;
+	const size_t size = count * sizeof(float);
+	const int iterations = 500;
+	const char* kernel_src = "\n" \
+		"__kernel void multiplication(__global float* output, __global float* input, __global float* input2, \n" \
+		" const unsigned int count) {            \n" \
+		" int i = get_global_id(0);              \n" \
+		" if(i < count) \n" \
+		" output[i] = input[i] * input2[i]; \n" \
+		"}                     \n";
+
+	AMFPrograms* pPrograms;
+	ASSERT_EQ(factory->GetPrograms(&pPrograms), AMF_OK);
+	AMF_KERNEL_ID kernel = 0;
+	ASSERT_EQ(pPrograms->RegisterKernelSource(&kernel, L"kernelIDName", "multiplication", strlen(kernel_src), (amf_uint8*)kernel_src, NULL), AMF_OK);
+	AMFComputeKernelPtr pKernel;
+	ASSERT_EQ(compute->GetKernel(kernel, &pKernel), AMF_OK);
+
+	// Both paths work on the same buffers and the same native queue
+	AMFContextPtr context;
+	ASSERT_EQ(factory->CreateContext(&context), AMF_OK);
+	ASSERT_EQ(context->InitOpenCL(compute->GetNativeCommandQueue()), AMF_OK);
+	AMFBufferPtr input;
+	AMFBufferPtr input2;
+	AMFBufferPtr output;
+	ASSERT_EQ(context->AllocBuffer(AMF_MEMORY_HOST, size, &input), AMF_OK);
+	ASSERT_EQ(context->AllocBuffer(AMF_MEMORY_HOST, size, &input2), AMF_OK);
+	ASSERT_EQ(context->AllocBuffer(AMF_MEMORY_OPENCL, size, &output), AMF_OK);
+	TestDataGenerator generator;
+	generator.FillUniform(static_cast<float*>(input->GetNative()), count, 0.0f, 655.0f);
+	generator.FillUniform(static_cast<float*>(input2->GetNative()), count, 0.0f, 655.0f);
+	vector<float> expectedData(count);
+	for (int k = 0; k < count; k++)
+	{
+		expectedData[k] = static_cast<float*>(input->GetNative())[k] * static_cast<float*>(input2->GetNative())[k];
+	}
+	ASSERT_EQ(input->Convert(AMF_MEMORY_OPENCL), AMF_OK);
+	ASSERT_EQ(input2->Convert(AMF_MEMORY_OPENCL), AMF_OK);
+
+	cl_command_queue queue = (cl_command_queue)compute->GetNativeCommandQueue();
+	cl_context nativeContext = (cl_context)compute->GetNativeContext();
+	cl_device_id nativeDevice = (cl_device_id)compute->GetNativeDeviceID();
+	cl_mem inputMem = (cl_mem)input->GetNative();
+	cl_mem input2Mem = (cl_mem)input2->GetNative();
+	cl_mem outputMem = (cl_mem)output->GetNative();
+	cl_uint nativeCount = count;
+
+	// Released on every return path, including the ASSERT early returns below
+	struct NativeKernel {
+		cl_program program = NULL;
+		cl_kernel kernel = NULL;
+
+		~NativeKernel() {
+			if (kernel) {
+				clReleaseKernel(kernel);
+			}
+			if (program) {
+				clReleaseProgram(program);
+			}
+		}
+	} native;
+	cl_int status = CL_SUCCESS;
+	native.program = clCreateProgramWithSource(nativeContext, 1, &kernel_src, NULL, &status);
+	ASSERT_EQ(status, CL_SUCCESS);
+	ASSERT_EQ(clBuildProgram(native.program, 1, &nativeDevice, NULL, NULL, NULL), CL_SUCCESS);
+	native.kernel = clCreateKernel(native.program, "multiplication", &status);
+	ASSERT_EQ(status, CL_SUCCESS);
+	ASSERT_EQ(clSetKernelArg(native.kernel, 0, sizeof(cl_mem), &outputMem), CL_SUCCESS);
+	ASSERT_EQ(clSetKernelArg(native.kernel, 1, sizeof(cl_mem), &inputMem), CL_SUCCESS);
+	ASSERT_EQ(clSetKernelArg(native.kernel, 2, sizeof(cl_mem), &input2Mem), CL_SUCCESS);
+	ASSERT_EQ(clSetKernelArg(native.kernel, 3, sizeof(cl_uint), &nativeCount), CL_SUCCESS);
+
+	ASSERT_EQ(pKernel->SetArgBuffer(0, output, AMF_ARGUMENT_ACCESS_WRITE), AMF_OK);
+	ASSERT_EQ(pKernel->SetArgBuffer(1, input, AMF_ARGUMENT_ACCESS_READ), AMF_OK);
+	ASSERT_EQ(pKernel->SetArgBuffer(2, input2, AMF_ARGUMENT_ACCESS_READ), AMF_OK);
+	ASSERT_EQ(pKernel->SetArgInt32(3, count), AMF_OK);
+	amf_size sizeLocal[3] = { 0, 0, 0 };
+	amf_size sizeGlobal[3] = { (amf_size)count, 0, 0 };
+	amf_size offset[3] = { 0, 0, 0 };
+	pKernel->GetCompileWorkgroupSize(sizeLocal);
+	size_t nativeGlobal = count;
+	size_t* nativeLocal = sizeLocal[0] ? &sizeLocal[0] : NULL;
+
+	vector<float> host(count);
+	const vector<float> zeros(count, 0.0f);
+	// Reads output back natively and counts the elements that differ from the expected product
+	auto outputMismatches = [&]() {
+		vector<float> result(count);
+		EXPECT_EQ(clEnqueueReadBuffer(queue, outputMem, CL_TRUE, 0, size, result.data(), 0, NULL, NULL), CL_SUCCESS);
+		int mismatches = 0;
+		for (int k = 0; k < count; k++)
+		{
+			mismatches += abs(expectedData[k] - result[k]) > 0.01;
+		}
+		return mismatches;
+	};
+	LatencyHistogram amfEnqueue, nativeEnqueue, amfKernel, nativeKernelTime;
+	LatencyHistogram amfRead, nativeRead, amfWrite, nativeWrite;
+	// Iteration 0 warms up both paths; AMF and native runs alternate so drift hits both equally
+	// The warm-up also checks each kernel on its own: output is cleared before each dispatch there
+	for (int i = 0; i <= iterations; i++)
+	{
+		if (i == 0)
+		{
+			ASSERT_EQ(clEnqueueWriteBuffer(queue, outputMem, CL_TRUE, 0, size, zeros.data(), 0, NULL, NULL), CL_SUCCESS);
+		}
+		auto amfStart = chrono::steady_clock::now();
+		ASSERT_EQ(pKernel->Enqueue(1, offset, sizeGlobal, sizeLocal), AMF_OK);
+		auto amfEnqueued = chrono::steady_clock::now();
+		ASSERT_EQ(compute->FinishQueue(), AMF_OK);
+		auto amfDone = chrono::steady_clock::now();
+		if (i == 0)
+		{
+			EXPECT_EQ(outputMismatches(), 0) << "AMF kernel output";
+			ASSERT_EQ(clEnqueueWriteBuffer(queue, outputMem, CL_TRUE, 0, size, zeros.data(), 0, NULL, NULL), CL_SUCCESS);
+		}
+
+		auto nativeStart = chrono::steady_clock::now();
+		ASSERT_EQ(clEnqueueNDRangeKernel(queue, native.kernel, 1, NULL, &nativeGlobal, nativeLocal, 0, NULL, NULL), CL_SUCCESS);
+		auto nativeEnqueued = chrono::steady_clock::now();
+		ASSERT_EQ(clFinish(queue), CL_SUCCESS);
+		auto nativeDone = chrono::steady_clock::now();
+		if (i == 0)
+		{
+			EXPECT_EQ(outputMismatches(), 0) << "OpenCL kernel output";
+		}
+
+		auto amfReadStart = chrono::steady_clock::now();
+		ASSERT_EQ(compute->CopyBufferToHost(output, 0, size, host.data(), true), AMF_OK);
+		auto amfReadDone = chrono::steady_clock::now();
+		ASSERT_EQ(clEnqueueReadBuffer(queue, outputMem, CL_TRUE, 0, size, host.data(), 0, NULL, NULL), CL_SUCCESS);
+		auto nativeReadDone = chrono::steady_clock::now();
+
+		ASSERT_EQ(compute->CopyBufferFromHost(host.data(), size, output, 0, true), AMF_OK);
+		auto amfWriteDone = chrono::steady_clock::now();
+		ASSERT_EQ(clEnqueueWriteBuffer(queue, outputMem, CL_TRUE, 0, size, host.data(), 0, NULL, NULL), CL_SUCCESS);
+		auto nativeWriteDone = chrono::steady_clock::now();
+
+		if (i == 0)
+		{
+			continue;
+		}
+		amfEnqueue.Record(amfEnqueued - amfStart);
+		amfKernel.Record(amfDone - amfStart);
+		nativeEnqueue.Record(nativeEnqueued - nativeStart);
+		nativeKernelTime.Record(nativeDone - nativeStart);
+		amfRead.Record(amfReadDone - amfReadStart);
+		nativeRead.Record(nativeReadDone - amfReadDone);
+		amfWrite.Record(amfWriteDone - nativeReadDone);
+		nativeWrite.Record(nativeWriteDone - amfWriteDone);
+	}
+
+	for (int k = 0; k < count; k++)
+	{
+		EXPECT_LE(abs(expectedData[k] - host[k]), 0.01);
+	}
+
+	auto logOverhead = [](const string& name, LatencyHistogram& amf, LatencyHistogram& native) {
+		logLatencyHistogram("AMF " + name, amf);
+		logLatencyHistogram("OpenCL " + name, native);
+		logTestMetric("AMF overhead " + name + " p50", ((double)amf.Percentile(50) - native.Percentile(50)) / 1000.0, "us");
+		logTestMetric("AMF overhead " + name + " p99", ((double)amf.Percentile(99) - native.Percentile(99)) / 1000.0, "us");
+	};
+	logOverhead("kernel enqueue", amfEnqueue, nativeEnqueue);
+	logOverhead("kernel enqueue and finish", amfKernel, nativeKernelTime);
+	logOverhead("read buffer", amfRead, nativeRead);
+	logOverhead("write buffer", amfWrite, nativeWrite);
+}
+
+TEST_F(Benchmark, hostStaging_allocationStrategies) {
+	const size_t size = 32 * 1024 * 1024;
+	const int iterations = 20;
+	const double megabytes = size / 1048576.0;
+	AMFBufferPtr deviceBuffer;
+	ASSERT_EQ(context1->AllocBuffer(AMF_MEMORY_OPENCL, size, &deviceBuffer), AMF_OK);
+
+	for (int s = 0; s < HOST_ALLOC_COUNT; s++)
+	{
+		HostAllocationStrategy strategy = (HostAllocationStrategy)s;
+		string name = hostAllocationStrategyName(strategy);
+		auto allocationStart = chrono::steady_clock::now();
+		HostAllocation host(strategy, size, context1.Get());
+		auto allocated = chrono::steady_clock::now();
+		EXPECT_TRUE(host.data) << name;
+		if (!host.data)
+		{
+			continue;
+		}
+		// The first write pays for the page faults of memory that was never touched
+		memset(host.data, 0x5A, size);
+		auto touched = chrono::steady_clock::now();
+
+		LatencyHistogram uploads;
+		LatencyHistogram downloads;
+		for (int i = 0; i < iterations; i++)
+		{
+			auto uploadStart = chrono::steady_clock::now();
+			compute->CopyBufferFromHost(host.data, size, deviceBuffer, 0, true);
+			auto uploaded = chrono::steady_clock::now();
+			compute->CopyBufferToHost(deviceBuffer, 0, size, host.data, true);
+			auto downloaded = chrono::steady_clock::now();
+			uploads.Record(uploaded - uploadStart);
+			downloads.Record(downloaded - uploaded);
+		}
+		EXPECT_EQ(static_cast<unsigned char*>(host.data)[size - 1], 0x5A) << name;
+
+		logTestNote(name + " memory", host.detail);
+		logTestMetric(name + " allocation", chrono::duration<double, micro>(allocated - allocationStart).count(), "us");
+		logTestMetric(name + " first touch", chrono::duration<double, micro>(touched - allocated).count(), "us");
+		logTestMetric(name + " upload bandwidth p50", megabytes / (uploads.Percentile(50) / 1e9), "MB/s");
+		logTestMetric(name + " download bandwidth p50", megabytes / (downloads.Percentile(50) / 1e9), "MB/s");
+		logLatencyHistogram(name + " upload", uploads);
+		logLatencyHistogram(name + " download", downloads);
+	}
+}
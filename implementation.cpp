@@ -2,10 +2,9 @@
 
 struct Implementation : testing::Test {
 	AMFFactoryHelper helper;
-	AMFContextPtr context1;
-	AMFComputeFactoryPtr oclComputeFactory;
-	AMFFactory* factory;
-	int deviceCount;
+	LazyResource<AMFFactory*> factory;
+	LazyResource<AMFContextPtr> context1;
+	LazyResource<AMFFactoryHelper*> amfRuntime;
 	chrono::time_point<chrono::system_clock> startTime;
 
 	static void SetUpTestCase() {
@@ -16,19 +15,31 @@ struct Implementation : testing::Test {
 		terminateTestSuiteLog();
 	}
 
-	Implementation() {
-		helper.Init();
-		factory = helper.GetFactory();
-		factory->CreateContext(&context1);
-		g_AMFFactory.Init();
+	Implementation() :
+		factory("AMF factory", [this](AMFFactory*& value) {
+			helper.Init();
+			value = helper.GetFactory();
+		}),
+		context1("AMF context", [this](AMFContextPtr& value) {
+			// The implementation checks run with g_AMFFactory initialized alongside the context
+			amfRuntime.Get();
+			factory->CreateContext(&value);
+		}),
+		amfRuntime("AMF runtime", [](AMFFactoryHelper*& value) {
+			g_AMFFactory.Init();
+			value = &g_AMFFactory;
+		}) {
 		startTime = initiateTestLog();
 	}
 
 	~Implementation() {
-		context1.Release();
-		oclComputeFactory.Release();
-		g_AMFFactory.Terminate();
-		helper.Terminate();
+		context1.value.Release();
+		if (amfRuntime.initialized) {
+			g_AMFFactory.Terminate();
+		}
+		if (factory.initialized) {
+			helper.Terminate();
+		}
 		terminateTestLog(startTime);
 	}
 };
@@ -1,12 +1,7 @@
 #include "autotests.h"
 
-struct Smoke : testing::Test {
-	AMFFactoryHelper helper;
-	AMFContextPtr context1;
-	AMFComputeFactoryPtr oclComputeFactory;
-	AMFFactory* factory;
-	int deviceCount;
-	chrono::time_point<chrono::system_clock> startTime;
+struct Smoke : OpenCLFixture {
+	LazyResource<AMFFactoryHelper*> tracing;
 
 	static void SetUpTestCase() {
 		//_CrtSetAllocHook(allocationHook);
@@ -17,46 +12,38 @@ struct Smoke : testing::Test {
 		terminateTestSuiteLog();
 	}
 
-	Smoke() {
-		helper.Init();
-		factory = helper.GetFactory();
-		factory->CreateContext(&context1);
-		context1->SetProperty(AMF_CONTEXT_DEVICE_TYPE, AMF_CONTEXT_DEVICE_TYPE_GPU);
-		context1->GetOpenCLComputeFactory(&oclComputeFactory);
-		context1->InitOpenCL();
-		deviceCount = oclComputeFactory->GetDeviceCount();
-		g_AMFFactory.Init();
-		g_AMFFactory.GetDebug()->AssertsEnable(true);
-		g_AMFFactory.GetTrace()->SetWriterLevel(AMF_TRACE_WRITER_FILE, AMF_TRACE_TRACE);
-		g_AMFFactory.GetTrace()->SetGlobalLevel(AMF_TRACE_TRACE);
-		g_AMFFactory.GetTrace()->SetWriterLevel(AMF_TRACE_WRITER_CONSOLE, AMF_TRACE_TRACE);
-		g_AMFFactory.GetTrace()->SetWriterLevelForScope(AMF_TRACE_WRITER_CONSOLE, L"scope2", AMF_TRACE_TRACE);
-		g_AMFFactory.GetTrace()->SetWriterLevelForScope(AMF_TRACE_WRITER_CONSOLE, L"scope2", AMF_TRACE_ERROR);
-		startTime = initiateTestLog();
-	}
-
-	~Smoke() {
-		context1.Release();
-		oclComputeFactory.Release();
-		g_AMFFactory.Terminate();
-		helper.Terminate();
-		terminateTestLog(startTime);
+	Smoke() :
+		tracing("AMF tracing", [this](AMFFactoryHelper*& value) {
+			value = amfRuntime.Get();
+			value->GetDebug()->AssertsEnable(true);
+			value->GetTrace()->SetWriterLevel(AMF_TRACE_WRITER_FILE, AMF_TRACE_TRACE);
+			value->GetTrace()->SetGlobalLevel(AMF_TRACE_TRACE);
+			value->GetTrace()->SetWriterLevel(AMF_TRACE_WRITER_CONSOLE, AMF_TRACE_TRACE);
+			value->GetTrace()->SetWriterLevelForScope(AMF_TRACE_WRITER_CONSOLE, L"scope2", AMF_TRACE_TRACE);
+			value->GetTrace()->SetWriterLevelForScope(AMF_TRACE_WRITER_CONSOLE, L"scope2", AMF_TRACE_ERROR);
+		}) {
+		// Every test that brings up OpenCL runs with the asserts and trace levels enabled
+		auto createContext = context1.create;
+		context1.create = [this, createContext](AMFContextPtr& value) {
+			tracing.Get();
+			createContext(value);
+		};
 	}
 };
 
 TEST_F(Smoke, set_cache_folder) {
-	g_AMFFactory.GetFactory()->SetCacheFolder(L"cache");
-	EXPECT_STREQ(g_AMFFactory.GetFactory()->GetCacheFolder(), L"cache");
+	amfRuntime->GetFactory()->SetCacheFolder(L"cache");
+	EXPECT_STREQ(amfRuntime->GetFactory()->GetCacheFolder(), L"cache");
 }
 
 TEST_F(Smoke, release_null_check) {
-	context1.Release();
-	EXPECT_EQ(context1, (amf::AMFContextPtr)NULL);
+	context1.Get().Release();
+	EXPECT_EQ(context1.Get(), (amf::AMFContextPtr)NULL);
 }
 
 TEST_F(Smoke, DISABLED_traceW_error) {
-	g_AMFFactory.GetTrace()->SetPath(L"traceW.log");
-	g_AMFFactory.GetTrace()->TraceW(L"path", 387, AMF_TRACE_ERROR, L"scope", 4, L"Error message");
+	tracing->GetTrace()->SetPath(L"traceW.log");
+	tracing->GetTrace()->TraceW(L"path", 387, AMF_TRACE_ERROR, L"scope", 4, L"Error message");
 	fstream fd;
 	fd.open("traceW.log", ios::in);
 	string log;
@@ -386,3 +373,107 @@ TEST_F(Smoke, compute_convertPlaneToPlane) {
 	pCompute->ConvertPlaneToPlane(plane, &plane2, AMF_CHANNEL_ORDER_R, AMF_CHANNEL_UNSIGNED_INT32);
 	EXPECT_TRUE(plane2);
 }
+
+static void fillBytePattern(vector<amf_uint8>& data, amf_uint8 salt) {
+	for (size_t k = 0; k < data.size(); k++) {
+		data[k] = (amf_uint8)(k * 131 + salt);
+	}
+}
+
+TEST_F(Smoke, compute_convertPlaneToBuffer_aliasing) {
+	AMFComputeDevice* device;
+	oclComputeFactory->GetDeviceAt(0, &device);
+	AMFComputePtr pCompute;
+	device->CreateCompute(nullptr, &pCompute);
+	const int resolutions[2][2] = { { 1920, 1080 }, { 3840, 2160 } };
+	for (auto& resolution : resolutions) {
+		const amf_size width = resolution[0];
+		const amf_size height = resolution[1];
+		string name = "ConvertPlaneToBuffer " + to_string(width) + "x" + to_string(height);
+		AMFSurfacePtr surface;
+		context1->AllocSurface(AMF_MEMORY_OPENCL, AMF_SURFACE_RGBA, (int)width, (int)height, &surface);
+		AMFPlanePtr plane = surface->GetPlane(AMF_PLANE_PACKED);
+
+		LatencyHistogram conversions;
+		AMFBufferPtr buffer;
+		for (int i = 0; i < 100; i++) {
+			buffer.Release();
+			auto start = chrono::steady_clock::now();
+			EXPECT_EQ(pCompute->ConvertPlaneToBuffer(plane, &buffer), AMF_OK);
+			conversions.Record(chrono::steady_clock::now() - start);
+		}
+		logLatencyHistogram(name, conversions);
+		ASSERT_TRUE(buffer);
+		logTestNote(name + " native handle", plane->GetNative() == buffer->GetNative() ? "shared" : "distinct");
+
+		// Write through the plane, read through the buffer, then the other way round
+		const amf_size rowBytes = width * plane->GetPixelSizeInBytes();
+		const amf_size bufferPitch = plane->GetHPitch();
+		amf_size origin[3] = { 0, 0, 0 };
+		amf_size region[3] = { width, height, 1 };
+		vector<amf_uint8> written(rowBytes * height);
+		vector<amf_uint8> read(buffer->GetSize());
+		ASSERT_GE(read.size(), bufferPitch * (height - 1) + rowBytes) << name;
+		fillBytePattern(written, 1);
+		pCompute->CopyPlaneFromHost(written.data(), origin, region, rowBytes, plane, true);
+		pCompute->CopyBufferToHost(buffer, 0, read.size(), read.data(), true);
+		bool planeVisibleInBuffer = true;
+		for (amf_size row = 0; row < height && planeVisibleInBuffer; row++) {
+			planeVisibleInBuffer = memcmp(&written[row * rowBytes], &read[row * bufferPitch], rowBytes) == 0;
+		}
+		EXPECT_TRUE(planeVisibleInBuffer) << name << ": buffer does not alias the plane";
+
+		fillBytePattern(read, 2);
+		pCompute->CopyBufferFromHost(read.data(), read.size(), buffer, 0, true);
+		pCompute->CopyPlaneToHost(plane, origin, region, written.data(), rowBytes, true);
+		bool bufferVisibleInPlane = true;
+		for (amf_size row = 0; row < height && bufferVisibleInPlane; row++) {
+			bufferVisibleInPlane = memcmp(&written[row * rowBytes], &read[row * bufferPitch], rowBytes) == 0;
+		}
+		EXPECT_TRUE(bufferVisibleInPlane) << name << ": plane does not alias the buffer";
+	}
+}
+
+TEST_F(Smoke, compute_convertPlaneToPlane_aliasing) {
+	AMFComputeDevice* device;
+	oclComputeFactory->GetDeviceAt(0, &device);
+	AMFComputePtr pCompute;
+	device->CreateCompute(nullptr, &pCompute);
+	const int resolutions[2][2] = { { 1920, 1080 }, { 3840, 2160 } };
+	for (auto& resolution : resolutions) {
+		const amf_size width = resolution[0];
+		const amf_size height = resolution[1];
+		string name = "ConvertPlaneToPlane " + to_string(width) + "x" + to_string(height);
+		AMFSurfacePtr surface;
+		context1->AllocSurface(AMF_MEMORY_OPENCL, AMF_SURFACE_RGBA, (int)width, (int)height, &surface);
+		AMFPlanePtr plane = surface->GetPlane(AMF_PLANE_PACKED);
+
+		// One RGBA8 pixel reinterpreted as one R32UI texel keeps the same width and row size
+		LatencyHistogram conversions;
+		AMFPlanePtr plane2;
+		for (int i = 0; i < 100; i++) {
+			plane2.Release();
+			auto start = chrono::steady_clock::now();
+			EXPECT_EQ(pCompute->ConvertPlaneToPlane(plane, &plane2, AMF_CHANNEL_ORDER_R, AMF_CHANNEL_UNSIGNED_INT32), AMF_OK);
+			conversions.Record(chrono::steady_clock::now() - start);
+		}
+		logLatencyHistogram(name, conversions);
+		ASSERT_TRUE(plane2);
+		logTestNote(name + " native handle", plane->GetNative() == plane2->GetNative() ? "shared" : "distinct");
+
+		const amf_size rowBytes = width * plane->GetPixelSizeInBytes();
+		amf_size origin[3] = { 0, 0, 0 };
+		amf_size region[3] = { width, height, 1 };
+		vector<amf_uint8> written(rowBytes * height);
+		vector<amf_uint8> read(rowBytes * height);
+		fillBytePattern(written, 3);
+		pCompute->CopyPlaneFromHost(written.data(), origin, region, rowBytes, plane, true);
+		pCompute->CopyPlaneToHost(plane2, origin, region, read.data(), rowBytes, true);
+		EXPECT_TRUE(written == read) << name << ": converted plane does not alias the source";
+
+		fillBytePattern(written, 4);
+		pCompute->CopyPlaneFromHost(written.data(), origin, region, rowBytes, plane2, true);
+		pCompute->CopyPlaneToHost(plane, origin, region, read.data(), rowBytes, true);
+		EXPECT_TRUE(written == read) << name << ": source does not alias the converted plane";
+	}
+}
@@ -1 +1,115 @@
-#include "autotests.h"
\ No newline at end of file
+#include "autotests.h"
+#include <algorithm>
+
+struct Multithread : OpenCLFixture {
+	static void SetUpTestCase() {
+		initiateTestSuiteLog("Multithread");
+	}
+
+	static void TearDownTestCase() {
+		terminateTestSuiteLog();
+	}
+
+	// Every thread drives its own AMFContext and wraps each round trip in that context's
+	// LockOpenCL/UnlockOpenCL. With sharedQueue all contexts wrap one native queue, otherwise each
+	// gets its own. Whether one context's lock excludes the others is not assumed: overlappingHolds
+	// counts holds that began while another thread still held its lock.
+	// Returns buffer round trips per second.
+	double runContention(bool sharedQueue, int threadCount, int iterations, LatencyHistogram& waits, LatencyHistogram& holds,
+		uint64_t& overlappingHolds) {
+		const size_t size = 256 * 1024;
+		AMFComputePtr sharedCompute;
+		if (sharedQueue) {
+			device->CreateCompute(nullptr, &sharedCompute);
+		}
+		vector<AMFComputePtr> queues(threadCount);
+		vector<AMFContextPtr> contexts(threadCount);
+		vector<AMFComputePtr> computes(threadCount);
+		vector<AMFBufferPtr> buffers(threadCount);
+		vector<vector<pair<chrono::steady_clock::time_point, chrono::steady_clock::time_point>>> holdIntervals(threadCount);
+		for (int t = 0; t < threadCount; t++) {
+			if (sharedQueue) {
+				queues[t] = sharedCompute;
+			}
+			else {
+				device->CreateCompute(nullptr, &queues[t]);
+			}
+			factory->CreateContext(&contexts[t]);
+			contexts[t]->InitOpenCL(queues[t]->GetNativeCommandQueue());
+			contexts[t]->GetCompute(AMF_MEMORY_OPENCL, &computes[t]);
+			contexts[t]->AllocBuffer(AMF_MEMORY_OPENCL, size, &buffers[t]);
+		}
+
+		auto worker = [&](int t) {
+			vector<char> host(size, (char)t);
+			holdIntervals[t].reserve(iterations);
+			for (int i = 0; i < iterations; i++) {
+				auto lockStart = chrono::steady_clock::now();
+				contexts[t]->LockOpenCL();
+				auto lockAcquired = chrono::steady_clock::now();
+				computes[t]->CopyBufferFromHost(host.data(), size, buffers[t], 0, true);
+				computes[t]->CopyBufferToHost(buffers[t], 0, size, host.data(), true);
+				auto lockReleasing = chrono::steady_clock::now();
+				contexts[t]->UnlockOpenCL();
+				holdIntervals[t].emplace_back(lockAcquired, lockReleasing);
+				waits.Record(lockAcquired - lockStart);
+				holds.Record(lockReleasing - lockAcquired);
+			}
+		};
+
+		auto runStart = chrono::steady_clock::now();
+		vector<thread> workers;
+		for (int t = 0; t < threadCount; t++) {
+			workers.emplace_back(worker, t);
+		}
+		for (auto& w : workers) {
+			w.join();
+		}
+		chrono::duration<double> runTime = chrono::steady_clock::now() - runStart;
+
+		// A thread's own holds never overlap, so any hold still open at an acquire belongs to another thread
+		vector<pair<chrono::steady_clock::time_point, chrono::steady_clock::time_point>> allHolds;
+		for (auto& intervals : holdIntervals) {
+			allHolds.insert(allHolds.end(), intervals.begin(), intervals.end());
+		}
+		sort(allHolds.begin(), allHolds.end());
+		overlappingHolds = 0;
+		chrono::steady_clock::time_point latestRelease;
+		for (auto& hold : allHolds) {
+			overlappingHolds += hold.first < latestRelease;
+			latestRelease = hold.second > latestRelease ? hold.second : latestRelease;
+		}
+
+		for (int t = 0; t < threadCount; t++) {
+			buffers[t].Release();
+			computes[t].Release();
+			contexts[t]->Terminate();
+		}
+		return threadCount * iterations / runTime.count();
+	}
+};
+
+TEST_F(Multithread, sharedQueue_lockContention) {
+	const int iterations = 200;
+	for (int threadCount = 1; threadCount <= 8; threadCount *= 2) {
+		LatencyHistogram sharedWaits, sharedHolds, ownWaits, ownHolds;
+		uint64_t sharedOverlaps, ownOverlaps;
+		double shared = runContention(true, threadCount, iterations, sharedWaits, sharedHolds, sharedOverlaps);
+		double own = runContention(false, threadCount, iterations, ownWaits, ownHolds, ownOverlaps);
+		string suffix = " x" + to_string(threadCount);
+		logTestMetric("Shared queue throughput" + suffix, shared, "round trips/s");
+		logLatencyHistogram("Shared queue lock wait" + suffix, sharedWaits);
+		logLatencyHistogram("Shared queue lock hold" + suffix, sharedHolds);
+		logTestMetric("Shared queue overlapping holds" + suffix, (double)sharedOverlaps, "");
+		if (threadCount > 1) {
+			logTestNote("Shared queue lock" + suffix, sharedOverlaps ? "does not exclude other contexts" : "excludes other contexts");
+		}
+		logTestMetric("Own queues throughput" + suffix, own, "round trips/s");
+		logLatencyHistogram("Own queues lock wait" + suffix, ownWaits);
+		logLatencyHistogram("Own queues lock hold" + suffix, ownHolds);
+		logTestMetric("Own queues overlapping holds" + suffix, (double)ownOverlaps, "");
+		logTestMetric("Shared/own throughput ratio" + suffix, shared / own, "");
+		EXPECT_EQ(sharedHolds.Count(), (uint64_t)threadCount * iterations);
+		EXPECT_EQ(ownHolds.Count(), (uint64_t)threadCount * iterations);
+	}
+}
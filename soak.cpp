@@ -0,0 +1,151 @@
+#include "autotests.h"
+#include <CL/cl.h>
+#include <CL/cl_ext.h>
+
+// Total minus free global memory of the first GPU; the free amount comes from the AMD extension, in KB
+uint64_t deviceMemoryUsed() {
+	static cl_device_id device = []() {
+		cl_platform_id platforms[8];
+		cl_uint platformCount = 0;
+		cl_device_id found = NULL;
+		clGetPlatformIDs(8, platforms, &platformCount);
+		for (cl_uint i = 0; i < platformCount && !found; i++) {
+			clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_GPU, 1, &found, NULL);
+		}
+		return found;
+	}();
+	cl_ulong total = 0;
+	size_t freeKilobytes[2] = { 0, 0 };
+	if (!device) {
+		return 0;
+	}
+	clGetDeviceInfo(device, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(total), &total, NULL);
+	if (clGetDeviceInfo(device, CL_DEVICE_GLOBAL_FREE_MEMORY_AMD, sizeof(freeKilobytes), freeKilobytes, NULL) != CL_SUCCESS) {
+		return 0;
+	}
+	return total - (uint64_t)freeKilobytes[0] * 1024;
+}
+
+// Repeats the selected tests until the soak duration has passed. Every test run is one operation,
+// samples are taken between iterations so each interval covers whole passes over the same tests,
+// and the process exits with the result once the last sample is in. The exit skips gtest's
+// program end, so no --gtest_output report is written in soak mode; soak.csv and out.log hold the results.
+class SoakListener : public testing::EmptyTestEventListener {
+	ofstream series;
+	vector<SoakSample> samples;
+	LatencyHistogram latencies;
+	LatencyHistogram runLatencies;
+	uint64_t operations = 0;
+	bool testsFailed = false;
+	chrono::steady_clock::duration interval;
+	chrono::steady_clock::time_point startTime;
+	chrono::steady_clock::time_point endTime;
+	chrono::steady_clock::time_point nextSample;
+	chrono::steady_clock::time_point testStart;
+
+	void OnTestProgramStart(const testing::UnitTest& unitTest) override {
+		interval = chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(soakIntervalSeconds()));
+		if (!(interval.count() > 0)) {
+			cerr << "AMF_AUTOTESTS_SOAK_INTERVAL must be a positive number of seconds" << endl;
+			exit(1);
+		}
+		if (!(soakDurationSeconds() / soakIntervalSeconds() >= soakMinSamples)) {
+			cerr << "Soak of " << soakDurationSeconds() << " s with samples every " << soakIntervalSeconds()
+				<< " s gives fewer than " << soakMinSamples << " samples; raise AMF_AUTOTESTS_SOAK_SECONDS"
+				<< " or lower AMF_AUTOTESTS_SOAK_INTERVAL" << endl;
+			exit(1);
+		}
+		if (!::testing::GTEST_FLAG(output).empty()) {
+			cerr << "Soak mode does not write the --gtest_output report" << endl;
+		}
+		// Read by gtest right after this callback, the iterations end in OnTestIterationEnd
+		::testing::GTEST_FLAG(repeat) = -1;
+		series.open("soak.csv", ios::out | ios::trunc);
+		series << "seconds,operations,latency_p50_us,latency_p99_us,latency_max_us,"
+			<< "host_memory,host_pointers,device_memory,handles,threads" << endl;
+		startTime = chrono::steady_clock::now();
+		endTime = startTime + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(soakDurationSeconds()));
+		nextSample = startTime + interval;
+	}
+
+	void OnTestStart(const testing::TestInfo& testInfo) override {
+		testStart = chrono::steady_clock::now();
+	}
+
+	void OnTestEnd(const testing::TestInfo& testInfo) override {
+		if (testInfo.result()->Skipped()) {
+			return;
+		}
+		latencies.Record(chrono::steady_clock::now() - testStart);
+		operations++;
+	}
+
+	void OnTestIterationEnd(const testing::UnitTest& unitTest, int iteration) override {
+		auto now = chrono::steady_clock::now();
+		testsFailed |= unitTest.Failed();
+		if (now >= nextSample && operations) {
+			SoakSample sample;
+			sample.seconds = chrono::duration<double>(now - startTime).count();
+			sample.operations = operations;
+			sample.latencyP50 = latencies.Percentile(50) / 1000.0;
+			sample.latencyP99 = latencies.Percentile(99) / 1000.0;
+			sample.latencyMax = latencies.Max() / 1000.0;
+			sample.hostMemory = memoryUsage.CurrentUsage();
+			sample.hostPointers = memoryUsage.CurrentPointers();
+			sample.deviceMemory = deviceMemoryUsed();
+			sample.resources = currentProcessResources();
+			series << sample.seconds << "," << sample.operations << "," << sample.latencyP50 << ","
+				<< sample.latencyP99 << "," << sample.latencyMax << "," << sample.hostMemory << ","
+				<< sample.hostPointers << "," << sample.deviceMemory << "," << sample.resources.handles << ","
+				<< sample.resources.threads << endl;
+			samples.push_back(sample);
+			runLatencies.Merge(latencies);
+			latencies.Reset();
+			operations = 0;
+			while (nextSample <= now) {
+				nextSample += interval;
+			}
+		}
+		if (now < endTime) {
+			return;
+		}
+		runLatencies.Merge(latencies);
+		series.close();
+		string drift = logSoakSummary(samples, runLatencies);
+		cout << "Soak finished after " << iteration + 1 << " iterations, " << samples.size() << " samples in soak.csv" << endl;
+		if (!drift.empty()) {
+			cout << "Soak drift: " << drift << endl;
+		}
+		if (testsFailed) {
+			cout << "Soak had failing tests" << endl;
+		}
+		exit(drift.empty() && !testsFailed ? 0 : 1);
+	}
+};
+
+// gtest sends end events to listeners in reverse order, so the result printer has to come after the
+// soak listener to report the last iteration before it exits. The printer is only final once
+// InitGoogleTest has parsed the flags, so it is moved from the first environment set-up.
+struct SoakPrinterOrder : testing::Environment {
+	bool moved = false;
+
+	void SetUp() override {
+		if (moved) {
+			return;
+		}
+		moved = true;
+		testing::TestEventListeners& listeners = testing::UnitTest::GetInstance()->listeners();
+		if (testing::TestEventListener* printer = listeners.Release(listeners.default_result_printer())) {
+			listeners.Append(printer);
+		}
+	}
+};
+
+struct SoakRegistration {
+	SoakRegistration() {
+		if (soakDurationSeconds()) {
+			testing::UnitTest::GetInstance()->listeners().Append(new SoakListener);
+			testing::AddGlobalTestEnvironment(new SoakPrinterOrder);
+		}
+	}
+} soakRegistration;